@@ -3267,6 +3267,26 @@ else
 fi
 ])# R_LZMA
 
+## R_ZSTD
+## -------
+## Try finding libzstd library and headers, unless --without-zstd.
+## We check that both are installed, and that the library has
+## ZSTD_compressStream2 (added in 1.4.0).
+AC_DEFUN([R_ZSTD],
+[if test "x${use_zstd}" = xyes; then
+  AC_CHECK_LIB(zstd, ZSTD_compressStream2, [have_zstd=yes], [have_zstd=no])
+  if test "${have_zstd}" = yes; then
+    AC_CHECK_HEADERS(zstd.h, [have_zstd=yes], [have_zstd=no])
+  fi
+else
+  have_zstd=no
+fi
+if test "x${have_zstd}" = xyes; then
+  AC_DEFINE(HAVE_ZSTD, 1, [Define if your system has libzstd >= 1.4.0.])
+  LIBS="-lzstd ${LIBS}"
+fi
+])# R_ZSTD
+
 
 ## R_SYS_POSIX_LEAPSECONDS
 ## -----------------------
@@ -881,6 +881,8 @@ extern0 int R_PCRE_study INI_as(-2);
 extern0 int R_PCRE_study INI_as(10);
 #endif
 extern0 int R_PCRE_limit_recursion;
+/* maximum number of compiled regular expressions kept */
+extern0 int R_RegexCacheSize INI_as(64);
 
 
 #ifdef __MAIN__
@@ -1353,6 +1355,10 @@ const char *EncodeChar(SEXP);
 /* main/raw.c */
 int mbrtoint(int *w, const char *s);
 
+/* main/RNG.c */
+Rboolean R_unif_rand_fill(double *u, R_xlen_t n);
+Rboolean R_norm_rand_fill(double *z, R_xlen_t n);
+
 /* main/sort.c */
 void orderVector1(int *indx, int n, SEXP key, Rboolean nalast,
 		  Rboolean decreasing, SEXP rho);
@@ -1373,6 +1379,8 @@ int utf8clen(char c);
 int Rf_AdobeSymbol2ucs2(int n);
 double R_strtod5(const char *str, char **endptr, char dec,
 		 Rboolean NA, int exact);
+void R_sprintReal(char *buf, size_t size, double x, int w, int d,
+		  Rboolean e, Rboolean alt);
 
 typedef unsigned short R_ucs2_t;
 size_t mbcsToUcs2(const char *in, R_ucs2_t *out, int nout, int enc);
@@ -1400,10 +1408,14 @@ char *Rf_strrchr(const char *s, int c);
 
 SEXP fixup_NaRm(SEXP args); /* summary.c */
 void invalidate_cached_recodings(void);  /* from sysutils.c */
+void R_SweepTranslationCache(Rboolean (*live)(SEXP));
 void resetICUcollator(Rboolean disable); /* from util.c */
 void dt_invalidate_locale(); /* from Rstrptime.h */
+void R_FlushRegexCache(void); /* from grep.c */
+void R_TrimRegexCache(void);
 extern int R_OutputCon; /* from connections.c */
 extern int R_InitReadItemDepth, R_ReadItemDepth; /* from serialize.c */
+SEXP R_mmap_file_region(SEXP, int, double, R_xlen_t); /* from altclasses.c */
 void get_current_mem(size_t *,size_t *,size_t *); /* from memory.c */
 unsigned long get_duplicate_counter(void);  /* from duplicate.c */
 void reset_duplicate_counter(void);  /* from duplicate.c */
@@ -68,6 +68,7 @@ typedef struct clpconn {
 int Rconn_fgetc(Rconnection con);
 int Rconn_ungetc(int c, Rconnection con);
 size_t Rconn_getline(Rconnection con, char *buf, size_t bufsize);
+R_xlen_t Rconn_readblock(Rconnection con, char *buf, size_t n);
 int Rconn_printf(Rconnection con, const char *format, ...);
 Rconnection getConnection(int n);
 Rconnection getConnection_no_err(int n);
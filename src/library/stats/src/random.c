@@ -240,13 +240,76 @@ DEFRAND2_REAL(rgamma)
 DEFRAND2_REAL(rlnorm)
 DEFRAND2_REAL(rlogis)
 DEFRAND2_INT(rnbinom)
-DEFRAND2_REAL(rnorm)
-DEFRAND2_REAL(runif)
 DEFRAND2_REAL(rweibull)
 DEFRAND2_INT(rwilcox)
 DEFRAND2_REAL(rnchisq)
 DEFRAND2_REAL(rnbinom_mu)
 
+/* rnorm() and runif() with scalar parameters: generate the variates a
+   block at a time, which gives the same stream as calling rnorm() or
+   runif() per element as those always use a fixed number of uniforms
+   when the parameters are valid and the variance non-zero. */
+
+static R_INLINE Rboolean scalarParams(SEXP sa, SEXP sb, double *a, double *b)
+{
+    if (!isNumeric(sa) || !isNumeric(sb) ||
+	XLENGTH(sa) != 1 || XLENGTH(sb) != 1)
+	return FALSE;
+    *a = asReal(sa);
+    *b = asReal(sb);
+    return TRUE;
+}
+
+SEXP do_rnorm(SEXP sn, SEXP sa, SEXP sb)
+{
+    double mu, sigma;
+    if (scalarParams(sa, sb, &mu, &sigma) &&
+	R_FINITE(mu) && R_FINITE(sigma) && sigma > 0) {
+	R_xlen_t n = resultLength(sn);
+	SEXP x = allocVector(REALSXP, n);
+	if (n == 0)
+	    return x;
+	PROTECT(x);
+	double *rx = REAL(x);
+	GetRNGstate();
+	Rboolean ok = R_norm_rand_fill(rx, n);
+	PutRNGstate();
+	if (ok) {
+	    for (R_xlen_t i = 0; i < n; i++)
+		rx[i] = mu + sigma * rx[i];
+	    UNPROTECT(1);
+	    return x;
+	}
+	UNPROTECT(1);
+    }
+    return random2(sn, sa, sb, rnorm, REALSXP);
+}
+
+SEXP do_runif(SEXP sn, SEXP sa, SEXP sb)
+{
+    double a, b;
+    if (scalarParams(sa, sb, &a, &b) &&
+	R_FINITE(a) && R_FINITE(b) && a < b) {
+	R_xlen_t n = resultLength(sn);
+	SEXP x = allocVector(REALSXP, n);
+	if (n == 0)
+	    return x;
+	PROTECT(x);
+	double *rx = REAL(x);
+	GetRNGstate();
+	Rboolean ok = R_unif_rand_fill(rx, n);
+	PutRNGstate();
+	if (ok) {
+	    for (R_xlen_t i = 0; i < n; i++)
+		rx[i] = a + (b - a) * rx[i];
+	    UNPROTECT(1);
+	    return x;
+	}
+	UNPROTECT(1);
+    }
+    return random2(sn, sa, sb, runif, REALSXP);
+}
+
 /* random sampling from 3 parameter families. */
 
 static R_INLINE SEXP random3(SEXP sn, SEXP sa, SEXP sb, SEXP sc, ran3 fn,
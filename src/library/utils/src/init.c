@@ -85,7 +85,7 @@ static const R_ExternalMethodDef ExtEntries[] = {
     EXTDEF(countfields, 6),
     EXTDEF(readtablehead, 7),
     EXTDEF(typeconvert, 5),
-    EXTDEF(writetable, 11),
+    EXTDEF(writetable, 12),
 
     EXTDEF(addhistory, 1),
     EXTDEF(loadhistory, 1),
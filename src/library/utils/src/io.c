@@ -963,7 +963,8 @@ no_more_lines:
 
 /* --------- write.table --------- */
 
-/* write.table(x, file, nr, nc, rnames, sep, eol, na, dec, quote, qstring)
+/* write.table(x, file, nr, nc, rnames, sep, eol, na, dec, quote, qstring,
+               threads)
    x is a matrix or data frame
    file is a connection
    sep eol dec qstring are character strings
@@ -1026,17 +1027,68 @@ static const char
     return EncodeElement0(x, indx, quote ? '"' : 0, dec);
 }
 
+/* Output is formatted a block of rows at a time into a byte buffer,
+   written by one call to the connection.  With threads > 1 and columns
+   which can be formatted without the R heap (numbers, logicals, factors
+   and strings which need no translation), blocks are formatted in
+   parallel, one per thread, and written in order. */
+
+#define WT_ROWS 1000 /* rows per block */
+#define WT_NB 1000
+
+typedef struct wt_buf {
+    char *data;
+    size_t len, size;
+} wt_buf;
+
+/* A column, found before writing.  For a matrix x is the matrix and off
+   the offset of the column.  lev[k] is level k encoded, or NULL. */
+typedef struct wt_col {
+    SEXP x, levels;
+    R_xlen_t off;
+    int type;
+    const void *data;
+    Rboolean quote;
+    const char **lev;
+} wt_col;
+
+typedef struct wt_spec {
+    const char *csep, *ceol, *cna, *sdec;
+    size_t nsep, neol;
+    Rboolean qmethod;
+    R_StringBuffer *strBuf;
+} wt_spec;
+
 typedef struct wt_info {
     Rboolean wasopen;
     Rconnection con;
     R_StringBuffer *buf;
     int savedigits;
+    wt_buf *out, *cur;
+    int nout;
 } wt_info;
 
+/* write out b, emptying it even if that fails */
+static void wt_flush(Rconnection con, wt_buf *b)
+{
+    size_t n = b->len;
+    if(n) {
+	b->len = 0;
+	b->data[n] = '\0';
+	Rconn_printf(con, "%s", b->data);
+    }
+}
+
 /* utility to cleanup e.g. after interrupts */
 static void wt_cleanup(void *data)
 {
     wt_info *ld = data;
+    /* what was formatted before an error, as if written cell by cell */
+    if(ld->cur) {
+	wt_buf *b = ld->cur;
+	ld->cur = NULL;
+	wt_flush(ld->con, b);
+    }
     if(!ld->wasopen) {
     	errno = 0;
     	ld->con->close(ld->con);
@@ -1049,18 +1101,254 @@ static void wt_cleanup(void *data)
 	}
     }	
     R_FreeStringBuffer(ld->buf);
+    for(int k = 0; k < ld->nout; k++) free(ld->out[k].data);
     R_print.digits = ld->savedigits;
 }
 
+/* make room for n more bytes (and a nul) in b: FALSE if out of memory */
+static Rboolean wt_grow(wt_buf *b, size_t n)
+{
+    if (b->len + n < b->size) return TRUE;
+    size_t size = 2 * b->size;
+    if (size < b->len + n + 1) size = b->len + n + 1;
+    if (size < 8192) size = 8192;
+    char *tmp = realloc(b->data, size);
+    if (!tmp) return FALSE;
+    b->data = tmp;
+    b->size = size;
+    return TRUE;
+}
+
+static R_INLINE Rboolean wt_put(wt_buf *b, const char *s, size_t n)
+{
+    if (!wt_grow(b, n)) return FALSE;
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+    return TRUE;
+}
+
+static R_INLINE SEXP wt_string(const wt_col *c, R_xlen_t k)
+{
+    return c->data ? ((const SEXP *) c->data)[k] : STRING_ELT(c->x, k);
+}
+
+/* isna() for a column */
+static Rboolean wt_isna(const wt_col *c, R_xlen_t k)
+{
+    switch(c->type) {
+    case LGLSXP:
+    case INTSXP:
+	return ((const int *) c->data)[k] == NA_INTEGER;
+    case REALSXP:
+	return ISNAN(((const double *) c->data)[k]);
+    case STRSXP:
+	return wt_string(c, k) == NA_STRING;
+    default:
+	return isna(c->x, k);
+    }
+}
+
+/* Does translateChar(s) return CHAR(s)?  (It may allocate or signal an
+   error otherwise, so only the main thread can use it.) */
+static R_INLINE Rboolean wt_native(SEXP s)
+{
+    return IS_ASCII(s) || (IS_UTF8(s) ? utf8locale :
+			   !IS_LATIN1(s) && !IS_BYTES(s));
+}
+
+/* EncodeElement2() of a string which needs no translation */
+static Rboolean wt_putstring(wt_buf *b, SEXP s, Rboolean quote,
+			     Rboolean qmethod)
+{
+    const char *p = CHAR(s);
+    size_t n = LENGTH(s);
+    if (!quote) return wt_put(b, p, n);
+    if (!wt_grow(b, 2 * n + 2)) return FALSE;
+    char *q = b->data + b->len;
+    *q++ = '"';
+    for(; *p;) {
+	if(*p == '"') *q++ = qmethod ? '\\' : '"';
+	*q++ = *p++;
+    }
+    *q++ = '"';
+    b->len = q - b->data;
+    return TRUE;
+}
+
+/* Encode a non-NA element (or an NA row name) as EncodeElement2() does,
+   without using the R heap or static storage so in any thread.  Returns
+   FALSE if this cannot be done here (with *nomem set if memory ran
+   out). */
+static Rboolean wt_encode(wt_buf *b, const wt_col *c, R_xlen_t k,
+			  const wt_spec *sp, Rboolean *nomem)
+{
+    char tmp[WT_NB], *p;
+    int n;
+    Rboolean ok;
+
+    switch(c->type) {
+    case LGLSXP:
+	ok = ((const int *) c->data)[k] ? wt_put(b, "TRUE", 4) :
+	    wt_put(b, "FALSE", 5);
+	break;
+    case INTSXP:
+    {
+	int v = ((const int *) c->data)[k];
+	unsigned int u = v < 0 ? 0U - (unsigned int) v : (unsigned int) v;
+	p = tmp + 16;
+	do {
+	    *--p = (char) ('0' + u % 10);
+	    u /= 10;
+	} while (u);
+	if (v < 0) *--p = '-';
+	ok = wt_put(b, p, tmp + 16 - p);
+	break;
+    }
+    case REALSXP:
+    {
+	double v = ((const double *) c->data)[k];
+	int w, d, e;
+	formatReal(&v, 1, &w, &d, &e, 0);
+	/* as EncodeReal0() */
+	if (v == 0.0) v = 0.0;
+	if (!R_FINITE(v))
+	    ok = v > 0 ? wt_put(b, "Inf", 3) : wt_put(b, "-Inf", 4);
+	else {
+	    R_sprintReal(tmp, WT_NB, v, w < WT_NB ? w : WT_NB - 1, d,
+			 (Rboolean) e, FALSE);
+	    n = (int) strlen(tmp);
+	    /* as EncodeReal0(), substitute the whole of dec for '.' */
+	    if (strcmp(sp->sdec, ".") && (p = memchr(tmp, '.', n)))
+		ok = wt_put(b, tmp, p - tmp) &&
+		    wt_put(b, sp->sdec, strlen(sp->sdec)) &&
+		    wt_put(b, p + 1, tmp + n - p - 1);
+	    else ok = wt_put(b, tmp, n);
+	}
+	break;
+    }
+    case STRSXP:
+    {
+	SEXP s = wt_string(c, k);
+	/* an NA row name is written as "NA" */
+	if (s != NA_STRING && !wt_native(s)) return FALSE;
+	ok = wt_putstring(b, s, c->quote, sp->qmethod);
+	break;
+    }
+    default:
+	return FALSE;
+    }
+    if (!ok) *nomem = TRUE;
+    return ok;
+}
+
+/* Write cell k of column j (counting from 1, 0 for the row names) to b:
+   in a worker thread (strBuf NULL) only if wt_encode() can.  Missing
+   row names are not written as 'na', but as EncodeElement2() does. */
+static Rboolean wt_cell(wt_buf *b, wt_col *c, R_xlen_t k, int j,
+			const wt_spec *sp, Rboolean *nomem)
+{
+    const char *tmp;
+
+    if(j > 0 && wt_isna(c, k)) tmp = sp->cna;
+    else if(!isNull(c->levels)) {
+	/* We do not assume factors have integer levels,
+	   although they should. */
+	R_xlen_t l;
+	if(c->type == INTSXP) l = ((const int *) c->data)[k] - 1;
+	else if(c->type == REALSXP)
+	    l = (R_xlen_t) (((const double *) c->data)[k] - 1);
+	else if(!sp->strBuf) return FALSE;
+	else
+	    error(_("column %s claims to be a factor but does not have numeric codes"),
+		  j);
+	if(l >= 0 && l < XLENGTH(c->levels) && c->lev[l]) tmp = c->lev[l];
+	else if(!sp->strBuf) return FALSE;
+	else {
+	    tmp = EncodeElement2(c->levels, l, c->quote, sp->qmethod,
+				 sp->strBuf, sp->sdec);
+	    size_t n = strlen(tmp) + 1;
+	    char *p = R_alloc(n, 1);
+	    memcpy(p, tmp, n);
+	    tmp = c->lev[l] = p;
+	}
+    } else if(wt_encode(b, c, k, sp, nomem)) return TRUE;
+    else if(*nomem || !sp->strBuf) return FALSE;
+    else
+	tmp = EncodeElement2(c->x, k, c->quote, sp->qmethod, sp->strBuf,
+			     sp->sdec);
+    if (wt_put(b, tmp, strlen(tmp))) return TRUE;
+    *nomem = TRUE;
+    return FALSE;
+}
+
+/* Format rows i0 to i1 - 1 into b.  Returns FALSE if a worker thread
+   could not. */
+static Rboolean wt_rows(wt_buf *b, wt_col *rn, wt_col *cols, int nc,
+			int i0, int i1, const wt_spec *sp, Rboolean *nomem)
+{
+    for(int i = i0; i < i1; i++) {
+	if(rn && (!wt_cell(b, rn, i, 0, sp, nomem) ||
+		  !wt_put(b, sp->csep, sp->nsep)))
+	    return FALSE;
+	for(int j = 0; j < nc; j++) {
+	    if(j > 0 && !wt_put(b, sp->csep, sp->nsep)) return FALSE;
+	    if(!wt_cell(b, cols + j, cols[j].off + i, j + 1, sp, nomem))
+		return FALSE;
+	}
+	if(!wt_put(b, sp->ceol, sp->neol)) return FALSE;
+    }
+    return TRUE;
+}
+
+
+
+/* Set up c for parallel use: FALSE if it cannot be. */
+static Rboolean wt_parallel(wt_col *c, Rboolean qmethod)
+{
+    switch(c->type) {
+    case STRSXP:
+	c->data = STRING_PTR_RO(c->x);
+	return isNull(c->levels);
+    case LGLSXP:
+    case REALSXP:
+	return isNull(c->levels);
+    case INTSXP:
+	break;
+    default:
+	return FALSE;
+    }
+    if(isNull(c->levels)) return TRUE;
+    if(TYPEOF(c->levels) != STRSXP) return FALSE;
+    /* encode the levels which need no translation now: others leave
+       their rows to the main thread */
+    R_xlen_t nlev = XLENGTH(c->levels);
+    wt_buf b = {NULL, 0, 0};
+    for(R_xlen_t l = 0; l < nlev; l++) {
+	SEXP s = STRING_ELT(c->levels, l);
+	if(c->lev[l] || s == NA_STRING || !wt_native(s)) continue;
+	b.len = 0;
+	if(!wt_putstring(&b, s, c->quote, qmethod) || !wt_put(&b, "", 1)) {
+	    free(b.data);
+	    error(_("cannot allocate buffer in write.table()"));
+	}
+	char *p = R_alloc(b.len, 1);
+	memcpy(p, b.data, b.len);
+	c->lev[l] = p;
+    }
+    free(b.data);
+    return TRUE;
+}
+
 SEXP writetable(SEXP call, SEXP op, SEXP args, SEXP env)
 {
     SEXP x, sep, rnames, eol, na, dec, quote, xj;
-    Rboolean wasopen, quote_rn = FALSE, *quote_col;
+    Rboolean wasopen, quote_rn = FALSE, *quote_col, nomem = FALSE;
     Rconnection con;
-    const char *csep, *ceol, *cna, *sdec, *tmp = NULL /* -Wall */;
-    SEXP *levels;
+    const char *csep, *ceol, *cna, *sdec;
     R_StringBuffer strBuf = {NULL, 0, MAXELTSIZE};
     wt_info wi;
+    wt_spec spec;
+    wt_col *cols, rn, *prn = NULL;
     RCNTXT cntxt;
 
     args = CDR(args);
@@ -1085,7 +1373,8 @@ SEXP writetable(SEXP call, SEXP op, SEXP args, SEXP env)
     na = CAR(args);		   args = CDR(args);
     dec = CAR(args);		   args = CDR(args);
     quote = CAR(args);		   args = CDR(args);
-    int qmethod = asLogical(CAR(args));
+    int qmethod = asLogical(CAR(args)); args = CDR(args);
+    int threads = asInteger(CAR(args));
 
     if(nr == NA_INTEGER) error(_("invalid '%s' argument"), "nr");
     if(nc == NA_INTEGER) error(_("invalid '%s' argument"), "nc");
@@ -1096,6 +1385,8 @@ SEXP writetable(SEXP call, SEXP op, SEXP args, SEXP env)
     if(!isString(na)) error(_("invalid '%s' argument"), "na");
     if(!isString(dec)) error(_("invalid '%s' argument"), "dec");
     if(qmethod == NA_LOGICAL) error(_("invalid '%s' argument"), "qmethod");
+    if(threads == NA_INTEGER || threads < 1)
+	error(_("invalid '%s' argument"), "threads");
     csep = translateChar(STRING_ELT(sep, 0));
     ceol = translateChar(STRING_ELT(eol, 0));
     cna = translateChar(STRING_ELT(na, 0));
@@ -1109,95 +1400,141 @@ SEXP writetable(SEXP call, SEXP op, SEXP args, SEXP env)
 	if(this == 0) quote_rn = TRUE;
 	if(this >  0) quote_col[this - 1] = TRUE;
     }
-    R_AllocStringBuffer(0, &strBuf);
-    PrintDefaults();
-    wi.savedigits = R_print.digits; R_print.digits = DBL_DIG;/* MAX precision */
-    wi.con = con;
-    wi.wasopen = wasopen;
-    wi.buf = &strBuf;
-    begincontext(&cntxt, CTXT_CCODE, call, R_BaseEnv, R_BaseEnv,
-		 R_NilValue, R_NilValue);
-    cntxt.cend = &wt_cleanup;
-    cntxt.cenddata = &wi;
 
+    /* the columns */
+    cols = (wt_col *) R_alloc(nc, sizeof(wt_col));
     if(isVectorList(x)) { /* A data frame */
-
 	/* handle factors internally, check integrity */
-	levels = (SEXP *) R_alloc(nc, sizeof(SEXP));
 	for(int j = 0; j < nc; j++) {
 	    xj = VECTOR_ELT(x, j);
 	    if(LENGTH(xj) != nr)
 		error(_("corrupt data frame -- length of column %d does not match nrows"),
 		      j+1);
+	    cols[j].x = xj;
+	    cols[j].off = 0;
 	    if(inherits(xj, "factor")) {
-		levels[j] = getAttrib(xj, R_LevelsSymbol);
-	    } else levels[j] = R_NilValue;
+		cols[j].levels = getAttrib(xj, R_LevelsSymbol);
+	    } else cols[j].levels = R_NilValue;
 	}
-
-	for(int i = 0; i < nr; i++) {
-	    if(i % 1000 == 999) R_CheckUserInterrupt();
-	    if(!isNull(rnames))
-		Rconn_printf(con, "%s%s",
-			     EncodeElement2(rnames, i, quote_rn, qmethod,
-					    &strBuf, sdec), csep);
-	    for(int j = 0; j < nc; j++) {
-		xj = VECTOR_ELT(x, j);
-		if(j > 0) Rconn_printf(con, "%s", csep);
-		if(isna(xj, i)) tmp = cna;
-		else {
-		    if(!isNull(levels[j])) {
-			/* We do not assume factors have integer levels,
-			   although they should. */
-			if(TYPEOF(xj) == INTSXP)
-			    tmp = EncodeElement2(levels[j], INTEGER(xj)[i] - 1,
-						 quote_col[j], qmethod,
-						 &strBuf, sdec);
-			else if(TYPEOF(xj) == REALSXP)
-			    tmp = EncodeElement2(levels[j],
-						 (R_xlen_t) (REAL(xj)[i] - 1),
-						 quote_col[j], qmethod,
-						 &strBuf, sdec);
-			else
-			    error(_("column %s claims to be a factor but does not have numeric codes"),
-				  j+1);
-		    } else {
-			tmp = EncodeElement2(xj, i, quote_col[j], qmethod,
-					     &strBuf, sdec);
-		    }
-		}
-		Rconn_printf(con, "%s", tmp);
-	    }
-	    Rconn_printf(con, "%s", ceol);
-	}
-
     } else { /* A matrix */
-
 	if(!isVectorAtomic(x))
 	    UNIMPLEMENTED_TYPE("write.table, matrix method", x);
 	/* quick integrity check */
 	if(XLENGTH(x) != (R_xlen_t)nr * nc)
 	    error(_("corrupt matrix -- dims do not match length"));
+	for(int j = 0; j < nc; j++) {
+	    cols[j].x = x;
+	    cols[j].off = (R_xlen_t)j * nr;
+	    cols[j].levels = R_NilValue;
+	}
+    }
+    for(int j = 0; j < nc; j++) {
+	wt_col *c = cols + j;
+	c->type = TYPEOF(c->x);
+	c->quote = quote_col[j];
+	c->data = NULL;
+	if(c->type == LGLSXP || c->type == INTSXP || c->type == REALSXP)
+	    c->data = DATAPTR_RO(c->x);
+	c->lev = NULL;
+	if(!isNull(c->levels)) {
+	    R_xlen_t nlev = XLENGTH(c->levels);
+	    c->lev = (const char **) R_alloc(nlev, sizeof(char *));
+	    for(R_xlen_t l = 0; l < nlev; l++) c->lev[l] = NULL;
+	}
+    }
+    if(!isNull(rnames)) {
+	rn.x = rnames;
+	rn.levels = R_NilValue;
+	rn.off = 0;
+	rn.type = STRSXP;
+	rn.data = NULL;
+	rn.quote = quote_rn;
+	rn.lev = NULL;
+	prn = &rn;
+    }
 
-	for(int i = 0; i < nr; i++) {
-	    if(i % 1000 == 999) R_CheckUserInterrupt();
-	    if(!isNull(rnames))
-		Rconn_printf(con, "%s%s",
-			     EncodeElement2(rnames, i, quote_rn, qmethod,
-					    &strBuf, sdec), csep);
-	    for(int j = 0; j < nc; j++) {
-		if(j > 0) Rconn_printf(con, "%s", csep);
-		if(isna(x, i + (R_xlen_t)j*nr)) tmp = cna;
-		else {
-		    tmp = EncodeElement2(x, i + (R_xlen_t)j*nr,
-		                         quote_col[j], qmethod,
-					&strBuf, sdec);
+    R_AllocStringBuffer(0, &strBuf);
+    PrintDefaults();
+    wi.savedigits = R_print.digits; R_print.digits = DBL_DIG;/* MAX precision */
+    wi.con = con;
+    wi.wasopen = wasopen;
+    wi.buf = &strBuf;
+    wi.nout = 0;
+    wi.cur = NULL;
+    spec.csep = csep; spec.nsep = strlen(csep);
+    spec.ceol = ceol; spec.neol = strlen(ceol);
+    spec.cna = cna;
+    spec.sdec = sdec;
+    spec.qmethod = qmethod;
+    spec.strBuf = &strBuf;
+    begincontext(&cntxt, CTXT_CCODE, call, R_BaseEnv, R_BaseEnv,
+		 R_NilValue, R_NilValue);
+    cntxt.cend = &wt_cleanup;
+    cntxt.cenddata = &wi;
+
+#ifndef _OPENMP
+    threads = 1;
+#endif
+    if(threads > 1 && nr > WT_ROWS) {
+	for(int j = 0; j < nc && threads > 1; j++)
+	    if(!wt_parallel(cols + j, qmethod)) threads = 1;
+	if(prn && !wt_parallel(prn, qmethod)) threads = 1;
+    } else threads = 1;
+    wi.out = (wt_buf *) R_alloc(threads, sizeof(wt_buf));
+    for(int k = 0; k < threads; k++) {
+	wi.out[k].data = NULL;
+	wi.out[k].len = wi.out[k].size = 0;
+    }
+    wi.nout = threads;
+
+    if(threads == 1) {
+	wi.cur = wi.out;
+	for(int i = 0; i < nr; i += WT_ROWS) {
+	    if(i) R_CheckUserInterrupt();
+	    int i1 = (nr - i > WT_ROWS) ? i + WT_ROWS : nr;
+	    if(!wt_rows(wi.out, prn, cols, nc, i, i1, &spec, &nomem))
+		error(_("cannot allocate buffer in write.table()"));
+	    wt_flush(con, wi.out);
+	}
+    } else {
+	/* each thread formats one block of rows at a time, failing if
+	   it needs the main thread, which then formats it */
+	wt_spec tspec = spec;
+	tspec.strBuf = NULL;
+	Rboolean *done = (Rboolean *) R_alloc(threads, sizeof(Rboolean)),
+	    *tnomem = (Rboolean *) R_alloc(threads, sizeof(Rboolean));
+	for(int i = 0; i < nr; i += threads * WT_ROWS) {
+	    if(i) R_CheckUserInterrupt();
+#ifdef _OPENMP
+# pragma omp parallel for num_threads(threads) schedule(static)
+#endif
+	    for(int k = 0; k < threads; k++) {
+		int i0 = i + k * WT_ROWS, i1 = i0 + WT_ROWS;
+		if(i0 > nr) i0 = nr;
+		if(i1 > nr) i1 = nr;
+		tnomem[k] = FALSE;
+		done[k] = wt_rows(wi.out + k, prn, cols, nc, i0, i1, &tspec,
+				  tnomem + k);
+	    }
+	    for(int k = 0; k < threads; k++) {
+		int i0 = i + k * WT_ROWS, i1 = i0 + WT_ROWS;
+		if(i0 > nr) i0 = nr;
+		if(i1 > nr) i1 = nr;
+		if(tnomem[k])
+		    error(_("cannot allocate buffer in write.table()"));
+		if(!done[k]) {
+		    wi.out[k].len = 0;
+		    wi.cur = wi.out + k;
+		    if(!wt_rows(wi.out + k, prn, cols, nc, i0, i1, &spec, &nomem))
+			error(_("cannot allocate buffer in write.table()"));
+		    wi.cur = NULL;
 		}
-		Rconn_printf(con, "%s", tmp);
+		wt_flush(con, wi.out + k);
 	    }
-	    Rconn_printf(con, "%s", ceol);
 	}
-
     }
+    wi.cur = NULL;
+
     endcontext(&cntxt);
     wt_cleanup(&wi);
     return R_NilValue;
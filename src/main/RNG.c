@@ -26,6 +26,7 @@
 #include <Defn.h>
 #include <Internal.h>
 #include <R_ext/Random.h>
+#include <Rmath.h>		/* for qnorm5 */
 
 /* Normal generator is not actually set here but in ../nmath/snorm.c */
 #define RNG_DEFAULT MERSENNE_TWISTER
@@ -92,6 +93,7 @@ RNGTAB RNG_Table[] =
 
 static void Randomize(RNGtype kind);
 static double MT_genrand(void);
+static void MT_genrand_fill(double *, R_xlen_t);
 static Int32 KT_next(void);
 static void RNG_Init_R_KT(Int32);
 static void RNG_Init_KT2(Int32);
@@ -660,44 +662,77 @@ MT_sgenrand(Int32 seed)
     (seed_array[0]&UPPER_MASK), seed_array[1], ..., seed_array[N-1]
    can take any values except all zeros.                             */
 
-static double MT_genrand(void)
+/* generate N words at one time */
+static void MT_nextstate(void)
 {
     Int32 y;
     static Int32 mag01[2]={0x0, MATRIX_A};
     /* mag01[x] = x * MATRIX_A  for x=0,1 */
+    int kk;
 
-    mti = dummy[0];
-
-    if (mti >= N) { /* generate N words at one time */
-	int kk;
-
-	if (mti == N+1)   /* if sgenrand() has not been called, */
-	    MT_sgenrand(4357); /* a default initial seed is used   */
-
-	for (kk = 0; kk < N - M; kk++) {
-	    y = (mt[kk] & UPPER_MASK) | (mt[kk+1] & LOWER_MASK);
-	    mt[kk] = mt[kk+M] ^ (y >> 1) ^ mag01[y & 0x1];
-	}
-	for (; kk < N - 1; kk++) {
-	    y = (mt[kk] & UPPER_MASK) | (mt[kk+1] & LOWER_MASK);
-	    mt[kk] = mt[kk+(M-N)] ^ (y >> 1) ^ mag01[y & 0x1];
-	}
-	y = (mt[N-1] & UPPER_MASK) | (mt[0] & LOWER_MASK);
-	mt[N-1] = mt[M-1] ^ (y >> 1) ^ mag01[y & 0x1];
+    if (mti == N+1)   /* if sgenrand() has not been called, */
+	MT_sgenrand(4357); /* a default initial seed is used   */
 
-	mti = 0;
+    for (kk = 0; kk < N - M; kk++) {
+	y = (mt[kk] & UPPER_MASK) | (mt[kk+1] & LOWER_MASK);
+	mt[kk] = mt[kk+M] ^ (y >> 1) ^ mag01[y & 0x1];
     }
+    for (; kk < N - 1; kk++) {
+	y = (mt[kk] & UPPER_MASK) | (mt[kk+1] & LOWER_MASK);
+	mt[kk] = mt[kk+(M-N)] ^ (y >> 1) ^ mag01[y & 0x1];
+    }
+    y = (mt[N-1] & UPPER_MASK) | (mt[0] & LOWER_MASK);
+    mt[N-1] = mt[M-1] ^ (y >> 1) ^ mag01[y & 0x1];
+
+    mti = 0;
+}
 
-    y = mt[mti++];
+static R_INLINE double MT_temper(Int32 y)
+{
     y ^= TEMPERING_SHIFT_U(y);
     y ^= TEMPERING_SHIFT_S(y) & TEMPERING_MASK_B;
     y ^= TEMPERING_SHIFT_T(y) & TEMPERING_MASK_C;
     y ^= TEMPERING_SHIFT_L(y);
-    dummy[0] = mti;
 
     return ( (double)y * 2.3283064365386963e-10 ); /* reals: [0,1)-interval */
 }
 
+static double MT_genrand(void)
+{
+    double value;
+
+    mti = dummy[0];
+
+    if (mti >= N)
+	MT_nextstate();
+
+    value = MT_temper(mt[mti++]);
+    dummy[0] = mti;
+
+    return value;
+}
+
+/* The same as n calls to fixup(MT_genrand()), but reading the state
+   vector a block at a time. */
+static void MT_genrand_fill(double *u, R_xlen_t n)
+{
+    R_xlen_t i = 0;
+
+    mti = dummy[0];
+
+    while (i < n) {
+	if (mti >= N)
+	    MT_nextstate();
+	R_xlen_t m = N - mti;
+	if (m > n - i) m = n - i;
+	for (R_xlen_t k = 0; k < m; k++)
+	    u[i + k] = fixup(MT_temper(mt[mti + k]));
+	mti += (int) m;
+	i += m;
+    }
+    dummy[0] = mti;
+}
+
 /*
    The following code was taken from earlier versions of
    http://www-cs-faculty.stanford.edu/~knuth/programs/rng.c-old
@@ -876,3 +911,53 @@ double R_unif_index(double dn)
 
 Sampletype R_sample_kind() { return Sample_kind; }
 
+
+/* Block generation, for use by rnorm(), runif() and friends.
+
+   R_unif_rand_fill() fills u[0:(n-1)] with the next n values of
+   unif_rand().  It returns FALSE without generating anything for
+   user-supplied generators, whose values are not guaranteed to lie in
+   (0,1) and hence may need the rejection step in runif().
+
+   R_norm_rand_fill() does the same for norm_rand() when the normal
+   kind is "Inversion", which always uses two uniforms per variate.
+   It returns FALSE without generating anything for other kinds.
+
+   The streams are identical to those of the scalar functions, so
+   results do not depend on which is used.
+*/
+
+#define RNG_FILL_CHUNK 1024
+
+static void unif_rand_fill(double *u, R_xlen_t n)
+{
+    if (RNG_kind == MERSENNE_TWISTER)
+	MT_genrand_fill(u, n);
+    else
+	for (R_xlen_t i = 0; i < n; i++) u[i] = unif_rand();
+}
+
+Rboolean R_unif_rand_fill(double *u, R_xlen_t n)
+{
+    if (RNG_kind == USER_UNIF) return FALSE;
+    unif_rand_fill(u, n);
+    return TRUE;
+}
+
+Rboolean R_norm_rand_fill(double *z, R_xlen_t n)
+{
+    const double BIG = 134217728; /* 2^27, as in ../nmath/snorm.c */
+    double u[2 * RNG_FILL_CHUNK];
+
+    if (N01_kind != INVERSION) return FALSE;
+    for (R_xlen_t i = 0; i < n; i += RNG_FILL_CHUNK) {
+	int m = (n - i < RNG_FILL_CHUNK) ? (int)(n - i) : RNG_FILL_CHUNK;
+	unif_rand_fill(u, 2 * m);
+	for (int k = 0; k < m; k++) {
+	    /* unif_rand() alone is not of high enough precision */
+	    double u1 = (int)(BIG * u[2 * k]) + u[2 * k + 1];
+	    z[i + k] = qnorm5(u1/BIG, 0.0, 1.0, 1, 0);
+	}
+    }
+    return TRUE;
+}
@@ -1260,6 +1260,12 @@ static SEXP mmap_file(SEXP file, int type, Rboolean ptrOK, Rboolean wrtOK,
 {
     error("mmap objects not supported on Windows yet");
 }
+
+SEXP attribute_hidden
+R_mmap_file_region(SEXP file, int type, double offset, R_xlen_t n)
+{
+    return NULL;
+}
 #else
 /* derived from the example in
   https://www.safaribooksonline.com/library/view/linux-system-programming/0596009585/ch04s03.html */
@@ -1321,6 +1327,38 @@ static SEXP mmap_file(SEXP file, int type, Rboolean ptrOK, Rboolean wrtOK,
 
     return make_mmap(p, file, sb.st_size, type, ptrOK, wrtOK, serOK);
 }
+
+/* Map the 'n' elements of type 'type' starting 'offset' bytes into
+   'file', as used by readRDS(mmap = TRUE).  The mapping is private,
+   so pages are shared with other processes mapping the file until
+   written to.  The result is not serialized as a reference to the
+   file.  Returns NULL if the region cannot be mapped, for example if
+   'offset' is not a multiple of the page size. */
+SEXP attribute_hidden
+R_mmap_file_region(SEXP file, int type, double offset, R_xlen_t n)
+{
+    const char *efn = R_ExpandFileName(translateCharFP(STRING_ELT(file, 0)));
+    size_t size = n * (type == INTSXP ? sizeof(int) : sizeof(double));
+    long pagesize = sysconf(_SC_PAGESIZE);
+    struct stat sb;
+
+    if (size == 0 || pagesize <= 0 || fmod(offset, (double) pagesize) != 0)
+	return NULL;
+    if (stat(efn, &sb) != 0 || ! S_ISREG(sb.st_mode) ||
+	offset + (double) size > (double) sb.st_size)
+	return NULL;
+
+    int fd = open(efn, O_RDONLY);
+    if (fd == -1)
+	return NULL;
+    void *p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+		   (off_t) offset);
+    close(fd); /* don't care if this fails */
+    if (p == MAP_FAILED)
+	return NULL;
+
+    return make_mmap(p, file, size, type, TRUE, FALSE, FALSE);
+}
 #endif
 
 static Rboolean asLogicalNA(SEXP x, Rboolean dflt)
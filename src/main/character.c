@@ -143,7 +143,9 @@ int R_nchar(SEXP string, nchar_type type_,
 	return LENGTH(string);
 	break;
     case Chars:
-	if (IS_UTF8(string)) {
+	if (IS_ASCII(string))
+	    return LENGTH(string);
+	else if (IS_UTF8(string)) {
 	    const char *p = CHAR(string);
 	    if (!utf8Valid(p)) {
 		if (!allowNA)
@@ -262,6 +264,11 @@ SEXP attribute_hidden do_nchar(SEXP call, SEXP op, SEXP args, SEXP env)
     int *s_ = INTEGER(s);
     for (R_xlen_t i = 0; i < len; i++) {
 	SEXP sxi = STRING_ELT(x, i);
+	if (sxi != NA_STRING &&
+	    (type_ == Bytes || (type_ == Chars && IS_ASCII(sxi)))) {
+	    s_[i] = LENGTH(sxi); /* as R_nchar(), without the message */
+	    continue;
+	}
 	char msg_i[30]; sprintf(msg_i, "element %ld", (long)i+1);
 	s_[i] = R_nchar(sxi, type_, allowNA, keepNA, msg_i);
     }
@@ -276,6 +283,17 @@ SEXP attribute_hidden do_nchar(SEXP call, SEXP op, SEXP args, SEXP env)
     return s;
 }
 
+/* The positions reached in the last UTF-8 string substr() walked:
+   nc[k] characters precede byte p[k] of el.  Extracting many
+   substrings from one string (as substring(x, starts, stops) does)
+   then resumes from the nearest preceding position rather than walking
+   from the start each time, and need not re-check validity. */
+typedef struct {
+    SEXP el;
+    int nc[2];
+    const char *p[2];
+} substr_pos;
+
 /* Assumes sa < so; sa, so are 1-based indices in character units to str,
    len is length of str in bytes, excluding the terminator.
 
@@ -284,25 +302,37 @@ SEXP attribute_hidden do_nchar(SEXP call, SEXP op, SEXP args, SEXP env)
 
    *rfrom may be invalid pointer when rlen is zero.
 */
-static void substr(const char *str, int len, int ienc, int sa, int so,
-                   R_xlen_t idx, int isascii, const char **rfrom,
-	           int *rlen, int assumevalid)
+static void substr(SEXP el, const char *str, int len, int ienc, int sa,
+		   int so, R_xlen_t idx, int isascii, const char **rfrom,
+		   int *rlen, substr_pos *pos)
 {
     int i;
     const char *end = str + len;
 
     if (ienc == CE_UTF8) {
-	if (!assumevalid && !utf8Valid(str)) {
+	i = 0;
+	if (pos->el == el) {
+	    for (int k = 0; k < 2; k++)
+		if (pos->nc[k] > i && pos->nc[k] <= sa - 1) {
+		    i = pos->nc[k];
+		    str = pos->p[k];
+		}
+	} else if (!utf8Valid(str)) {
 	    char msg[30];
 	    sprintf(msg, "element %ld", (long)idx+1);
 	    error(_("invalid multibyte string, %s"), msg);
 	}
-	for (i = 0; i < sa - 1 && str < end; i++)
+	for (; i < sa - 1 && str < end; i++)
 	    str += utf8clen(*str);
 	*rfrom = str;
+	pos->nc[0] = i;
+	pos->p[0] = str;
 	for(; i < so && str < end; i++)
 	    str += utf8clen(*str);
 	*rlen = (int) (str - *rfrom);
+	pos->nc[1] = i;
+	pos->p[1] = str;
+	pos->el = el;
     } else if (!isascii && ienc != CE_LATIN1 && ienc != CE_BYTES
                && mbcslocale) {
 	mbstate_t mb_st;
@@ -339,7 +369,7 @@ do_substr(SEXP call, SEXP op, SEXP args, SEXP env)
 	error(_("extracting substrings from a non-character object"));
     R_xlen_t len = XLENGTH(x);
     PROTECT(s = allocVector(STRSXP, len));
-    SEXP lastel = NULL;
+    substr_pos pos = { NULL, {0, 0}, {NULL, NULL} };
     if (len > 0) {
 	SEXP sa = CADR(args),
 	    so = CADDR(args);
@@ -366,15 +396,10 @@ do_substr(SEXP call, SEXP op, SEXP args, SEXP env)
 	    } else {
 		const char *rfrom;
 		int rlen;
-		/* Skip checking UTF-8 validity if the string is the same
-		   R object as previously. This improves performance of
-		   substring() used on a single string but many substrings
-		   to be extracted from it */
-		substr(ss, slen, ienc, start, stop, i,
-		       IS_ASCII(el), &rfrom, &rlen, el == lastel);
+		substr(el, ss, slen, ienc, start, stop, i,
+		       IS_ASCII(el), &rfrom, &rlen, &pos);
 		SET_STRING_ELT(s, i, mkCharLenCE(rfrom, rlen, ienc));
 	    }
-	    lastel = el;
 	}
     }
     SHALLOW_DUPLICATE_ATTRIB(s, x);
@@ -491,12 +516,16 @@ do_startsWith(SEXP call, SEXP op, SEXP args, SEXP env)
 
 static void
 substrset(char *buf, const char *const str, cetype_t ienc, int sa, int so,
-          R_xlen_t xidx, R_xlen_t vidx)
+          R_xlen_t xidx, R_xlen_t vidx, Rboolean ascii)
 {
     /* Replace the substring buf[sa:so] by str[] */
     int i, in = 0, out = 0;
 
-    if (ienc == CE_UTF8) {
+    if (ascii) { /* both ASCII: chars are bytes in any encoding */
+	in = (int) strlen(str);
+	out = so - sa + 1;
+	memcpy(buf + sa - 1, str, (in < out) ? in : out);
+    } else if (ienc == CE_UTF8) {
 	if (!utf8Valid(buf)) {
 	    char msg[30];
 	    sprintf(msg, "element %ld", (long)xidx+1);
@@ -604,7 +633,8 @@ SEXP attribute_hidden do_substrgets(SEXP call, SEXP op, SEXP args, SEXP env)
 		/* might expand under MBCS */
 		buf = R_AllocStringBuffer(slen+strlen(v_ss), &cbuff);
 		strcpy(buf, ss);
-		substrset(buf, v_ss, ienc2, start, stop, i, i % v);
+		substrset(buf, v_ss, ienc2, start, stop, i, i % v,
+			  IS_ASCII(el) && IS_ASCII(v_el));
 		SET_STRING_ELT(s, i, mkCharCE(buf, ienc2));
 	    }
 	    vmaxset(vmax);
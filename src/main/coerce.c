@@ -29,6 +29,7 @@
 #include <Parse.h>
 #include <Defn.h> /*-- Maybe modularize into own Coerce.h ..*/
 #include <Internal.h>
+#include <ctype.h> /* for isspace */
 #include <float.h> /* for DBL_DIG */
 #define R_MSG_mode	_("invalid 'mode' argument")
 #define R_MSG_list_vec	_("applies only to lists and vectors")
@@ -227,6 +228,40 @@ RealFromString(SEXP x, int *warn)
     return NA_REAL;
 }
 
+/* RealFromString() for the elements of a character vector: ASCII
+   strings (most) need no multibyte checks for blanks, and a string
+   repeating the previous element is not converted again. */
+static void RealFromStrings(SEXP v, double *pa, R_xlen_t n, int *warn)
+{
+    SEXP x, prev = NULL;
+    double val = NA_REAL;
+    int w = 0;
+    const char *p;
+    char *endp;
+
+    for (R_xlen_t i = 0; i < n; i++) {
+	x = STRING_ELT(v, i);
+	if (x != prev) {
+	    prev = x;
+	    w = 0;
+	    if (x == NA_STRING) val = NA_REAL;
+	    else if (IS_ASCII(x)) {
+		for (p = CHAR(x); isspace((int)*p); p++) ;
+		if (*p) {
+		    val = R_strtod(p, &endp);
+		    for (p = endp; isspace((int)*p); p++) ;
+		    if (*p) {
+			val = NA_REAL;
+			w = WARN_NA;
+		    }
+		} else val = NA_REAL;
+	    } else val = RealFromString(x, &w);
+	}
+	pa[i] = val;
+	*warn |= w;
+    }
+}
+
 Rcomplex attribute_hidden
 ComplexFromLogical(int x, int *warn)
 {
@@ -593,10 +628,7 @@ static SEXP coerceToReal(SEXP v)
 	}
 	break;
     case STRSXP:
-	for (i = 0; i < n; i++) {
-//	    if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
-	    pa[i] = RealFromString(STRING_ELT(v, i), &warn);
-	}
+	RealFromStrings(v, pa, n, &warn);
 	break;
     case RAWSXP:
 	for (i = 0; i < n; i++) {
@@ -94,6 +94,7 @@ int attribute_hidden R_OutputCon; /* used in printutils.c */
 static void con_destroy(int i);
 
 #include <errno.h>
+#include <stdint.h>
 
 #ifdef HAVE_UNISTD_H
 # include <unistd.h>
@@ -238,6 +239,7 @@ static void NORET set_iconv_error(Rconnection con, char* from, char* to)
 /* ------------------- buffering --------------------- */
 
 #define RBUFFCON_LEN_DEFAULT 4096
+#define RBUFFCON_LEN_BULK 65536
 
 # define MAX(a, b) ((a) > (b) ? (a) : (b))
 # define MIN(a, b) ((a) > (b) ? (b) : (a))
@@ -1681,6 +1683,8 @@ typedef struct gzconn {
 typedef struct gzfileconn {
     void *fp;
     int compress;
+    int threads; /* for parallel compression when writing and
+		    read-ahead when reading */
 } *Rgzfileconn;
 
 static Rboolean gzfile_open(Rconnection con)
@@ -1709,6 +1713,17 @@ static Rboolean gzfile_open(Rconnection con)
 	        name, strerror(errno));
 	return FALSE;
     }
+    /* when reading, threads > 1 decompresses ahead in another thread */
+    if(gzcon->threads > 1 && R_gzsetthreads(fp, gzcon->threads) != Z_OK) {
+	R_gzclose(fp);
+	if(mode[0] == 'r')
+	    warning(_("cannot allocate buffers for reading file '%s' ahead"),
+		    name);
+	else
+	    warning(_("cannot allocate buffers for compressing file '%s' with %d threads"),
+		    name, gzcon->threads);
+	return FALSE;
+    }
     ((Rgzfileconn)(con->private))->fp = fp;
     con->isopen = TRUE;
     con->canwrite = (con->mode[0] == 'w' || con->mode[0] == 'a');
@@ -1818,6 +1833,7 @@ static Rconnection newgzfile(const char *description, const char *mode,
 	/* for Solaris 12.5 */ new = NULL;
     }
     ((Rgzfileconn)new->private)->compress = compress;
+    ((Rgzfileconn)new->private)->threads = 1;
     return new;
 }
 
@@ -2243,12 +2259,230 @@ newxzfile(const char *description, const char *mode, int type, int compress)
     return new;
 }
 
-/* op 0 is gzfile, 1 is bzfile, 2 is xv/lzma */
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zstd_errors.h> /* for ZSTD_getErrorCode */
+
+typedef struct zstdfileconn {
+    FILE *fp;
+    ZSTD_CCtx *cctx;
+    ZSTD_DCtx *dctx;
+    ZSTD_inBuffer in; /* unconsumed input in buf when reading */
+    Rboolean eof, inframe;
+    int compress;
+    int threads;
+    unsigned char buf[BUFSIZE];
+} *Rzstdfileconn;
+
+static Rboolean zstdfile_open(Rconnection con)
+{
+    Rzstdfileconn zs = con->private;
+    char mode[] = "rb";
+    const char *name;
+
+    con->canwrite = (con->mode[0] == 'w' || con->mode[0] == 'a');
+    con->canread = !con->canwrite;
+    /* regardless of the R view of the file, the file must be opened in
+       binary mode where it matters */
+    mode[0] = con->mode[0];
+    errno = 0; /* precaution */
+    name = R_ExpandFileName(con->description);
+    zs->fp = R_fopen(name, mode);
+    if(!zs->fp) {
+	warning(_("cannot open compressed file '%s', probable reason '%s'"),
+		name, strerror(errno));
+	return FALSE;
+    }
+    if (isDir(zs->fp)) {
+	warning(_("cannot open file '%s': it is a directory"), name);
+	fclose(zs->fp);
+	return FALSE;
+    }
+    if(con->canread) {
+	zs->dctx = ZSTD_createDCtx();
+	if (!zs->dctx) {
+	    warning(_("cannot initialize zstd decoder"));
+	    fclose(zs->fp);
+	    return FALSE;
+	}
+	zs->in.src = zs->buf;
+	zs->in.size = zs->in.pos = 0;
+	zs->eof = zs->inframe = FALSE;
+    } else {
+	zs->cctx = ZSTD_createCCtx();
+	if (!zs->cctx) {
+	    warning(_("cannot initialize zstd encoder"));
+	    fclose(zs->fp);
+	    return FALSE;
+	}
+	ZSTD_CCtx_setParameter(zs->cctx, ZSTD_c_compressionLevel, zs->compress);
+	ZSTD_CCtx_setParameter(zs->cctx, ZSTD_c_checksumFlag, 1);
+	if (zs->threads > 1 &&
+	    ZSTD_isError(ZSTD_CCtx_setParameter(zs->cctx, ZSTD_c_nbWorkers,
+						zs->threads)))
+	    warning(_("this version of zstd does not support multi-threaded compression"));
+    }
+    con->isopen = TRUE;
+    con->text = strchr(con->mode, 'b') ? FALSE : TRUE;
+    set_buffer(con);
+    set_iconv(con);
+    con->save = -1000;
+    return TRUE;
+}
+
+static void zstdfile_close(Rconnection con)
+{
+    Rzstdfileconn zs = con->private;
+
+    if(con->canwrite) {
+	ZSTD_inBuffer in = { NULL, 0, 0 };
+	size_t ret;
+	do {
+	    ZSTD_outBuffer out = { zs->buf, BUFSIZE, 0 };
+	    ret = ZSTD_compressStream2(zs->cctx, &out, &in, ZSTD_e_end);
+	    if (ZSTD_isError(ret)) {
+		warning("zstd encoding error: %s", ZSTD_getErrorName(ret));
+		break;
+	    }
+	    if (fwrite(zs->buf, 1, out.pos, zs->fp) != out.pos)
+		error("fwrite error");
+	} while (ret);
+	ZSTD_freeCCtx(zs->cctx);
+	zs->cctx = NULL;
+    } else {
+	ZSTD_freeDCtx(zs->dctx);
+	zs->dctx = NULL;
+    }
+    fclose(zs->fp);
+    con->isopen = FALSE;
+}
+
+static size_t zstdfile_read(void *ptr, size_t size, size_t nitems,
+			    Rconnection con)
+{
+    Rzstdfileconn zs = con->private;
+    ZSTD_outBuffer out = { ptr, size*nitems, 0 };
+    size_t ret = 0, last, lastin;
+
+    if (!out.size) return 0;
+
+    while (out.pos < out.size) {
+	if (zs->in.pos == zs->in.size && !zs->eof) {
+	    zs->in.size = fread(zs->buf, 1, BUFSIZE, zs->fp);
+	    zs->in.pos = 0;
+	    if (feof(zs->fp) || ferror(zs->fp)) zs->eof = TRUE;
+	}
+	last = out.pos; lastin = zs->in.pos;
+	ret = ZSTD_decompressStream(zs->dctx, &out, &zs->in);
+	if (ZSTD_isError(ret)) {
+	    warning("zstd decoding error: %s", ZSTD_getErrorName(ret));
+	    break;
+	}
+	/* ret == 0 marks the end of a frame: further frames may follow */
+	if (out.pos != last || zs->in.pos != lastin) zs->inframe = (ret != 0);
+	/* no more input and nothing buffered by the decoder */
+	if (zs->eof && zs->in.pos == zs->in.size && out.pos == last) {
+	    if (zs->inframe) {
+		zs->inframe = FALSE; /* warn only once */
+		warning("zstd decoder: incomplete compressed data");
+	    }
+	    break;
+	}
+    }
+    return out.pos/size;
+}
+
+static int zstdfile_fgetc_internal(Rconnection con)
+{
+    unsigned char buf[1];
+    size_t size = zstdfile_read(buf, 1, 1, con);
+
+    return (size < 1) ? R_EOF : buf[0];
+}
+
+static size_t zstdfile_write(const void *ptr, size_t size, size_t nitems,
+			     Rconnection con)
+{
+    Rzstdfileconn zs = con->private;
+    ZSTD_inBuffer in = { ptr, size*nitems, 0 };
+
+    if (!in.size) return 0;
+
+    while (in.pos < in.size) {
+	ZSTD_outBuffer out = { zs->buf, BUFSIZE, 0 };
+	size_t ret = ZSTD_compressStream2(zs->cctx, &out, &in, ZSTD_e_continue);
+	if (ZSTD_isError(ret)) {
+	    warning("zstd encoding error: %s", ZSTD_getErrorName(ret));
+	    return 0;
+	}
+	if (fwrite(zs->buf, 1, out.pos, zs->fp) != out.pos)
+	    error("fwrite error");
+    }
+    return nitems;
+}
+#endif
+
+static Rconnection
+newzstdfile(const char *description, const char *mode, int compress,
+	    int threads)
+{
+#ifdef HAVE_ZSTD
+    Rconnection new;
+    new = (Rconnection) malloc(sizeof(struct Rconn));
+    if(!new) error(_("allocation of zstdfile connection failed"));
+    new->class = (char *) malloc(strlen("zstdfile") + 1);
+    if(!new->class) {
+	free(new);
+	error(_("allocation of zstdfile connection failed"));
+	/* for Solaris 12.5 */ new = NULL;
+    }
+    strcpy(new->class, "zstdfile");
+    new->description = (char *) malloc(strlen(description) + 1);
+    if(!new->description) {
+	free(new->class); free(new);
+	error(_("allocation of zstdfile connection failed"));
+	/* for Solaris 12.5 */ new = NULL;
+    }
+    init_con(new, description, CE_NATIVE, mode);
+
+    new->canseek = FALSE;
+    new->open = &zstdfile_open;
+    new->close = &zstdfile_close;
+    new->vfprintf = &dummy_vfprintf;
+    new->fgetc_internal = &zstdfile_fgetc_internal;
+    new->fgetc = &dummy_fgetc;
+    new->seek = &null_seek;
+    new->fflush = &null_fflush;
+    new->read = &zstdfile_read;
+    new->write = &zstdfile_write;
+    new->private = (void *) malloc(sizeof(struct zstdfileconn));
+    if(!new->private) {
+	free(new->description); free(new->class); free(new);
+	error(_("allocation of zstdfile connection failed"));
+	/* for Solaris 12.5 */ new = NULL;
+    }
+    memset(new->private, 0, sizeof(struct zstdfileconn));
+    ((Rzstdfileconn) new->private)->compress = compress;
+    ((Rzstdfileconn) new->private)->threads = threads;
+    return new;
+#else
+    error(_("zstd compression is not supported by this build of R"));
+    return NULL; /* -Wall */
+#endif
+}
+
+/* zstd frames start with 28 B5 2F FD */
+static Rboolean is_zstd_magic(const char *buf)
+{
+    return !memcmp(buf, "\x28\xB5\x2F\xFD", 4);
+}
+
+/* op 0 is gzfile, 1 is bzfile, 2 is xv/lzma, 3 is zstd */
 SEXP attribute_hidden do_gzfile(SEXP call, SEXP op, SEXP args, SEXP env)
 {
     SEXP sfile, sopen, ans, class, enc;
     const char *file, *open;
-    int ncon, compress = 9;
+    int ncon, compress = 9, threads = 1;
     Rconnection con = NULL;
     int type = PRIMVAL(op);
     int subtype = 0;
@@ -2278,6 +2512,16 @@ SEXP attribute_hidden do_gzfile(SEXP call, SEXP op, SEXP args, SEXP env)
 	if(compress == NA_LOGICAL || abs(compress) > 9)
 	    error(_("invalid '%s' argument"), "compress");
     }
+    if(type == 3) {
+	compress = asInteger(CADDDR(args));
+	if(compress == NA_INTEGER || compress < -7 || compress > 22)
+	    error(_("invalid '%s' argument"), "compress");
+    }
+    if(type == 0 || type == 3) {
+	threads = asInteger(CAD4R(args));
+	if(threads == NA_INTEGER || threads < 1)
+	    error(_("invalid '%s' argument"), "threads");
+    }
     open = CHAR(STRING_ELT(sopen, 0)); /* ASCII */
     if (type == 0 && (!open[0] || open[0] == 'r')) {
 	/* check magic no */
@@ -2295,6 +2539,7 @@ SEXP attribute_hidden do_gzfile(SEXP call, SEXP op, SEXP args, SEXP env)
 		if(!memcmp(buf, "]\0\0\200\0", 5)) {
 		    type = 2; subtype = 1;
 		}
+		if(is_zstd_magic(buf)) type = 3;
 		if((buf[0] == '\x89') && !strncmp(buf+1, "LZO", 3))
 		    error(_("this is a %s-compressed file which this build of R does not support"), "lzop");
 	    }
@@ -2303,6 +2548,7 @@ SEXP attribute_hidden do_gzfile(SEXP call, SEXP op, SEXP args, SEXP env)
     switch(type) {
     case 0:
 	con = newgzfile(file, strlen(open) ? open : "rb", compress);
+	((Rgzfileconn)con->private)->threads = threads;
 	break;
     case 1:
 	con = newbzfile(file, strlen(open) ? open : "rb", compress);
@@ -2310,6 +2556,9 @@ SEXP attribute_hidden do_gzfile(SEXP call, SEXP op, SEXP args, SEXP env)
     case 2:
 	con = newxzfile(file, strlen(open) ? open : "rb", subtype, compress);
 	break;
+    case 3:
+	con = newzstdfile(file, strlen(open) ? open : "rb", compress, threads);
+	break;
     }
     ncon = NextConnection();
     Connections[ncon] = con;
@@ -2343,6 +2592,9 @@ SEXP attribute_hidden do_gzfile(SEXP call, SEXP op, SEXP args, SEXP env)
     case 2:
 	SET_STRING_ELT(class, 0, mkChar("xzfile"));
 	break;
+    case 3:
+	SET_STRING_ELT(class, 0, mkChar("zstdfile"));
+	break;
     }
     SET_STRING_ELT(class, 1, mkChar("connection"));
     classgets(ans, class);
@@ -2353,6 +2605,69 @@ SEXP attribute_hidden do_gzfile(SEXP call, SEXP op, SEXP args, SEXP env)
     return ans;
 }
 
+/* .Internal(compressedAt(con, offset)): make a [bgx]zipped or zstd file
+   connection open for reading decompress the stream starting 'offset'
+   bytes into its file, as load() does for an object of an indexed save */
+SEXP attribute_hidden do_compressedat(SEXP call, SEXP op, SEXP args, SEXP env)
+{
+    checkArity(op, args);
+    Rconnection con = getConnection(asInteger(CAR(args)));
+    double where = asReal(CADR(args));
+    int res = -1;
+
+    if(!con->isopen || !con->canread || con->text)
+	error(_("connection is not open for reading in binary mode"));
+    if(!R_FINITE(where) || where < 0)
+	error(_("invalid '%s' argument"), "offset");
+    Rz_off_t offset = (Rz_off_t) where;
+    if(streql(con->class, "gzfile")) {
+	res = R_gzsetstart(((Rgzfileconn)(con->private))->fp, offset);
+    } else if(streql(con->class, "bzfile")) {
+	Rbzfileconn bz = con->private;
+	int bzerror;
+	BZ2_bzReadClose(&bzerror, bz->bfp);
+	bz->bfp = NULL;
+	if(f_seek(bz->fp, offset, SEEK_SET) == 0) {
+	    bz->bfp = BZ2_bzReadOpen(&bzerror, bz->fp, 0, 0, NULL, 0);
+	    if(bzerror == BZ_OK) res = 0;
+	    else {
+		BZ2_bzReadClose(&bzerror, bz->bfp);
+		bz->bfp = NULL;
+	    }
+	}
+	/* keep bzfile_close from using a closed stream */
+	if(res) {
+	    fclose(bz->fp);
+	    con->isopen = FALSE;
+	}
+    } else if(streql(con->class, "xzfile")) {
+	Rxzfileconn xz = con->private;
+	lzma_end(&xz->stream);
+	memset(&xz->stream, 0, sizeof(lzma_stream));
+	xz->action = LZMA_RUN;
+	/* a single stream: whatever follows it is not xz data */
+	if((xz->type == 1 ?
+	    lzma_alone_decoder(&xz->stream, 536870912) :
+	    lzma_stream_decoder(&xz->stream, 536870912, 0))
+	   == LZMA_OK)
+	    res = f_seek(xz->fp, offset, SEEK_SET);
+    }
+#ifdef HAVE_ZSTD
+    else if(streql(con->class, "zstdfile")) {
+	Rzstdfileconn zs = con->private;
+	ZSTD_DCtx_reset(zs->dctx, ZSTD_reset_session_only);
+	zs->in.size = zs->in.pos = 0;
+	zs->eof = zs->inframe = FALSE;
+	res = f_seek(zs->fp, offset, SEEK_SET);
+    }
+#endif
+    else error(_("'con' is not a compressed file connection"));
+    if(res)
+	error(_("cannot start reading the compressed stream at offset %.0f"),
+	      where);
+    return R_NilValue;
+}
+
 /* ------------------- clipboard connections --------------------- */
 
 #ifdef Win32
@@ -3887,6 +4202,106 @@ static void con_cleanup(void *data)
 
 /* readLines(con = stdin(), n = 1, ok = TRUE, warn = TRUE) */
 #define BUF_SIZE 1000
+/* Read a line from the buffer of a buffered connection which needs no
+   re-encoding, scanning the buffer with memchr rather than fetching a
+   character at a time.  The end-of-line handling matches Rconn_fgetc:
+   CR and CRLF are mapped to LF.  Returns '\n' or R_EOF as the character
+   which ended the line, which is stored in *buf (of size *buf_size)
+   with length *nbuf. */
+static int buff_readline(Rconnection con, char **buf, size_t *buf_size,
+			 size_t *nbuf, Rboolean skipNul)
+{
+    *nbuf = 0;
+    if (con->save != -1000) { /* pending CR-CR from a previous line */
+	int c = con->save;
+	con->save = -1000;
+	if (c == '\n' || c == R_EOF) return c;
+	(*buf)[(*nbuf)++] = (char) c;
+    }
+    for(;;) {
+	if (con->buff_pos == con->buff_stored_len && buff_fill(con) == 0)
+	    return R_EOF;
+	unsigned char *p = con->buff + con->buff_pos,
+	    *nl, *cr = NULL;
+	size_t len = con->buff_stored_len - con->buff_pos;
+	nl = memchr(p, '\n', len);
+	if (nl) len = nl - p;
+	if (len) cr = memchr(p, '\r', len);
+	if (cr) len = cr - p;
+	if (*nbuf + len >= *buf_size) { /* need space for the terminator */
+	    size_t newsize = *buf_size;
+	    while (*nbuf + len >= newsize) newsize *= 2;
+	    char *tmp = (char *) realloc(*buf, newsize);
+	    if(!tmp) {
+		free(*buf);
+		error(_("cannot allocate buffer in readLines"));
+	    }
+	    *buf = tmp; *buf_size = newsize;
+	}
+	if (skipNul) {
+	    for(size_t i = 0; i < len; i++)
+		if (p[i]) (*buf)[(*nbuf)++] = (char) p[i];
+	} else {
+	    memcpy(*buf + *nbuf, p, len);
+	    *nbuf += len;
+	}
+	con->buff_pos += len;
+	if (cr) {
+	    con->buff_pos++;
+	    if (con->buff_pos == con->buff_stored_len) buff_fill(con);
+	    if (con->buff_pos < con->buff_stored_len) {
+		int c = con->buff[con->buff_pos];
+		if (c == '\n') con->buff_pos++;
+		else if (c == '\r') {
+		    /* as Rconn_fgetc, CR CR is two line ends */
+		    con->buff_pos++;
+		    con->save = '\n';
+		}
+	    }
+	    return '\n';
+	}
+	if (nl) {
+	    con->buff_pos++;
+	    return '\n';
+	}
+    }
+}
+
+/* Copy up to n bytes of the remaining input of a buffered connection
+   which needs no re-encoding to buf, for scan() to parse in blocks.
+   Unlike Rconn_fgetc, CR is not mapped.  Returns the number of bytes
+   copied, fewer than n only at the end of the input, or -1 if the
+   connection cannot be read like this (including when there is
+   pushback). */
+R_xlen_t attribute_hidden Rconn_readblock(Rconnection con, char *buf, size_t n)
+{
+    size_t m = 0, k;
+
+    if (!con->buff || !con->blocking || con->inconv ||
+	con->fgetc != &dummy_fgetc ||
+	con->nPushBack > 0 || con->save2 != -1000 || con->save != -1000)
+	return -1;
+    while (m < n) {
+	if (con->buff_pos == con->buff_stored_len) {
+	    if (n - m >= con->buff_len) {
+		/* read large amounts directly */
+		k = con->read(buf + m, sizeof(char), n - m, con);
+		if (k == (size_t) -1)
+		    error("error reading from the connection");
+		if (k == 0) break;
+		m += k;
+		continue;
+	    }
+	    if (buff_fill(con) == 0) break;
+	}
+	k = MIN(con->buff_stored_len - con->buff_pos, n - m);
+	memcpy(buf + m, con->buff + con->buff_pos, k);
+	con->buff_pos += k;
+	m += k;
+    }
+    return (R_xlen_t) m;
+}
+
 SEXP attribute_hidden do_readLines(SEXP call, SEXP op, SEXP args, SEXP env)
 {
     SEXP ans = R_NilValue, ans2;
@@ -3945,6 +4360,14 @@ SEXP attribute_hidden do_readLines(SEXP call, SEXP op, SEXP args, SEXP env)
     if(con->UTF8out || streql(encoding, "UTF-8")) oenc = CE_UTF8;
     else if(streql(encoding, "latin1")) oenc = CE_LATIN1;
 
+    /* Lines can be split directly out of the connection buffer unless
+       the input is re-encoded or has been pushed back. */
+    Rboolean bulk = con->buff && !con->inconv && con->fgetc == &dummy_fgetc
+	&& con->nPushBack <= 0 && con->save2 == -1000;
+    /* when reading to the end, read ahead in larger blocks */
+    if(bulk && n < 0 && con->buff_len < RBUFFCON_LEN_BULK)
+	buff_set_len(con, RBUFFCON_LEN_BULK);
+
     buf = (char *) malloc(buf_size);
     if(!buf)
 	error(_("cannot allocate buffer in readLines"));
@@ -3963,21 +4386,25 @@ SEXP attribute_hidden do_readLines(SEXP call, SEXP op, SEXP args, SEXP env)
 	    PROTECT(ans = ans2);
 	}
 	nbuf = 0;
-	while((c = Rconn_fgetc(con)) != R_EOF) {
-	    if(nbuf == buf_size-1) {  /* need space for the terminator */
-		buf_size *= 2;
-		char *tmp = (char *) realloc(buf, buf_size);
-		if(!buf) {
-		    free(buf);
-		    error(_("cannot allocate buffer in readLines"));
-		} else buf = tmp;
+	if(bulk)
+	    c = buff_readline(con, &buf, &buf_size, &nbuf, skipNul);
+	else {
+	    while((c = Rconn_fgetc(con)) != R_EOF) {
+		if(nbuf == buf_size-1) {  /* need space for the terminator */
+		    buf_size *= 2;
+		    char *tmp = (char *) realloc(buf, buf_size);
+		    if(!buf) {
+			free(buf);
+			error(_("cannot allocate buffer in readLines"));
+		    } else buf = tmp;
+		}
+		if(skipNul && c == '\0') continue;
+		if(c != '\n')
+		    /* compiler-defined conversion behavior */
+		    buf[nbuf++] = (char) c;
+		else
+		    break;
 	    }
-	    if(skipNul && c == '\0') continue;
-	    if(c != '\n')
-		/* compiler-defined conversion behavior */
-		buf[nbuf++] = (char) c;
-	    else
-		break;
 	}
 	buf[nbuf] = '\0';
 	/* Remove UTF-8 BOM */
@@ -4107,6 +4534,51 @@ static void swapb(void *result, int size)
     }
 }
 
+/* Reverse the bytes of each of n items of 'size' bytes at p (which is
+   suitably aligned).  The loops for the usual sizes compile to bswap
+   instructions, vectorized where the compiler can. */
+static void swapbn(void *p, int size, R_xlen_t n)
+{
+    R_xlen_t i;
+
+    switch(size) {
+    case 1:
+	break;
+    case 2:
+    {
+	uint16_t *q = p;
+	for (i = 0; i < n; i++)
+	    q[i] = (uint16_t)((q[i] << 8) | (q[i] >> 8));
+	break;
+    }
+    case 4:
+    {
+	uint32_t *q = p;
+	for (i = 0; i < n; i++) {
+	    uint32_t x = q[i];
+	    q[i] = (x << 24) | ((x << 8) & 0xff0000u) |
+		((x >> 8) & 0xff00u) | (x >> 24);
+	}
+	break;
+    }
+    case 8:
+    {
+	uint64_t *q = p;
+	for (i = 0; i < n; i++) {
+	    uint64_t x = q[i];
+	    x = ((x << 8) & 0xff00ff00ff00ff00ull) |
+		((x >> 8) & 0x00ff00ff00ff00ffull);
+	    x = ((x << 16) & 0xffff0000ffff0000ull) |
+		((x >> 16) & 0x0000ffff0000ffffull);
+	    q[i] = (x << 32) | (x >> 32);
+	}
+	break;
+    }
+    default:
+	for (i = 0; i < n; i++) swapb((char *) p + i * size, size);
+    }
+}
+
 static SEXP readOneString(Rconnection con)
 {
     char buf[10001], *p;
@@ -4256,11 +4728,7 @@ SEXP attribute_hidden do_readbin(SEXP call, SEXP op, SEXP args, SEXP env)
 		pp += n1 * size;
 	    }
 	}
-	if(swap)
-	    for(i = 0; i < m; i++) {
-		swapb(&(COMPLEX(ans)[i].r), sizeof(double));
-		swapb(&(COMPLEX(ans)[i].i), sizeof(double));
-	    }
+	if(swap) swapbn(COMPLEX(ans), sizeof(double), 2 * m);
     } else {
 	if (!strcmp(what, "integer") || !strcmp(what, "int")) {
 	    sizedef = sizeof(int); mode = 1;
@@ -4343,78 +4811,79 @@ SEXP attribute_hidden do_readbin(SEXP call, SEXP op, SEXP args, SEXP env)
 		    pp += n1 * size;
 		}
 	    }
-	    if(swap && size > 1)
-		for(i = 0; i < m; i++) swapb((char *)p+i*size, size);
+	    if(swap) swapbn(p, size, m);
 	} else {
-	    R_xlen_t s;
-	    union {
-		signed char sch;
-		unsigned char uch;
-		signed short ssh;
-		unsigned short ush;
-		long l;
-		long long ll;
-		float f;
-#if HAVE_LONG_DOUBLE
-		long double ld;
-#endif
-	    } u;
-	    if (size > sizeof u)
-		error(_("size %d is unknown on this machine"), size);
-	    if(mode == 1) { /* integer result */
-		for(i = 0, m = 0; i < n; i++) {
-		    s = isRaw ? rawRead((char*) &u, size, 1, bytes, nbytes, &np)
-			: (int) con->read((char*) &u, size, 1, con);
-		    if (s < 0) error("error reading from the connection");
-		    if(s) m++; else break;
-		    if(swap && size > 1) swapb((char *) &u, size);
+	    /* Read blocks of items into a buffer and convert them from
+	       there, rather than reading and converting one at a time. */
+	    const void *vmax = vmaxget();
+	    char *buf = R_alloc(BLOCK, size);
+	    R_xlen_t m0;
+	    m = 0;
+	    while(m < n) {
+		size_t n1 = (n - m < BLOCK) ? n - m : BLOCK;
+		m0 = isRaw ? rawRead(buf, size, n1, bytes, nbytes, &np)
+		    : (R_xlen_t) con->read(buf, size, n1, con);
+		if (m0 < 0) error("error reading from the connection");
+		if(swap) swapbn(buf, size, m0);
+		if(mode == 1) { /* integer result */
+		    int *ians = INTEGER(ans) + m;
 		    switch(size) {
 		    case sizeof(signed char):
 			if(signd)
-			    INTEGER(ans)[i] = u.sch;
+			    for(i = 0; i < m0; i++)
+				ians[i] = ((signed char *) buf)[i];
 			else
-			    INTEGER(ans)[i] = u.uch;
+			    for(i = 0; i < m0; i++)
+				ians[i] = ((unsigned char *) buf)[i];
 			break;
 		    case sizeof(short):
 			if(signd)
-			    INTEGER(ans)[i] = u.ssh;
+			    for(i = 0; i < m0; i++)
+				ians[i] = ((short *) buf)[i];
 			else
-			    INTEGER(ans)[i] = u.ush;
+			    for(i = 0; i < m0; i++)
+				ians[i] = ((unsigned short *) buf)[i];
 			break;
 #if SIZEOF_LONG == 8
 		    case sizeof(long):
-			INTEGER(ans)[i] = (int) u.l;
+			for(i = 0; i < m0; i++)
+			    ians[i] = (int) ((long *) buf)[i];
 			break;
 #elif SIZEOF_LONG_LONG == 8
 		    case sizeof(_lli_t):
-			INTEGER(ans)[i] = (int) u.ll;
+			for(i = 0; i < m0; i++)
+			    ians[i] = (int) ((_lli_t *) buf)[i];
 			break;
 #endif
 		    default:
 			error(_("size %d is unknown on this machine"), size);
 		    }
-		}
-	    } else if (mode == 2) { /* double result */
-		for(i = 0, m = 0; i < n; i++) {
-		    s = isRaw ? rawRead((char*) &u, size, 1, bytes, nbytes, &np)
-			: (int) con->read((char*) &u, size, 1, con);
-		    if (s < 0) error("error reading from the connection");
-		    if(s) m++; else break;
-		    if(swap && size > 1) swapb((char *) &u, size);
+		} else { /* double result */
+		    double *rans = REAL(ans) + m;
 		    switch(size) {
 		    case sizeof(float):
-			REAL(ans)[i] = u.f;
+			for(i = 0; i < m0; i++)
+			    rans[i] = ((float *) buf)[i];
 			break;
 #if HAVE_LONG_DOUBLE && (SIZEOF_LONG_DOUBLE > SIZEOF_DOUBLE)
 		    case sizeof(long double):
-			REAL(ans)[i] = (double) u.ld;
+		    {
+			long double ld;
+			for(i = 0; i < m0; i++) {
+			    memcpy(&ld, buf + i * size, size);
+			    rans[i] = (double) ld;
+			}
 			break;
+		    }
 #endif
 		    default:
 			error(_("size %d is unknown on this machine"), size);
 		    }
 		}
+		m += m0;
+		if (m0 < n1) break;
 	    }
+	    vmaxset(vmax);
 	}
     }
     if(!wasopen) {endcontext(&cntxt); con->close(con);}
@@ -4424,6 +4893,101 @@ SEXP attribute_hidden do_readbin(SEXP call, SEXP op, SEXP args, SEXP env)
     return ans;
 }
 
+/* The size of the items of an atomic vector as stored */
+static int nativeSize(SEXP object)
+{
+    switch(TYPEOF(object)) {
+    case LGLSXP:
+    case INTSXP: return sizeof(int);
+    case REALSXP: return sizeof(double);
+    case CPLXSXP: return sizeof(Rcomplex);
+    default: return 1;
+    }
+}
+
+/* Convert items from .. from+n-1 of an atomic vector to items of 'size'
+   bytes in buf (which is suitably aligned), swapping bytes if asked. */
+static void binItems(SEXP object, R_xlen_t from, R_xlen_t n, int size,
+		     int swap, char *buf)
+{
+    R_xlen_t i;
+
+    switch(TYPEOF(object)) {
+    case LGLSXP:
+    case INTSXP:
+    {
+	const int *x = INTEGER(object) + from;
+	switch (size) {
+	case sizeof(int):
+	    memcpy(buf, x, size * n);
+	    break;
+#if SIZEOF_LONG == 8
+	case sizeof(long):
+	    for (i = 0; i < n; i++) ((long *) buf)[i] = (long) x[i];
+	    break;
+#elif SIZEOF_LONG_LONG == 8
+	case sizeof(_lli_t):
+	    for (i = 0; i < n; i++) ((_lli_t *) buf)[i] = (_lli_t) x[i];
+	    break;
+#endif
+	case 2:
+	    for (i = 0; i < n; i++) ((short *) buf)[i] = (short) x[i];
+	    break;
+	case 1:
+	    for (i = 0; i < n; i++)
+		/* compiler-defined conversion behavior */
+		buf[i] = (signed char) x[i];
+	    break;
+	default:
+	    error(_("size %d is unknown on this machine"), size);
+	}
+	break;
+    }
+    case REALSXP:
+    {
+	const double *x = REAL(object) + from;
+	switch (size) {
+	case sizeof(double):
+	    memcpy(buf, x, size * n);
+	    break;
+	case sizeof(float):
+	    for (i = 0; i < n; i++) ((float *) buf)[i] = (float) x[i];
+	    break;
+#if HAVE_LONG_DOUBLE && (SIZEOF_LONG_DOUBLE > SIZEOF_DOUBLE)
+	case sizeof(long double):
+	{
+	    /* some systems have problems with memcpy from
+	       the address of an automatic long double,
+	       e.g. ix86/x86_64 Linux with gcc4 */
+	    static long double ld1;
+	    for (i = 0; i < n; i++) {
+		ld1 = (long double) x[i];
+		memcpy(buf + i * size, &ld1, size);
+	    }
+	    break;
+	}
+#endif
+	default:
+	    error(_("size %d is unknown on this machine"), size);
+	}
+	break;
+    }
+    case CPLXSXP:
+	memcpy(buf, COMPLEX(object) + from, size * n);
+	break;
+    case RAWSXP:
+	memcpy(buf, RAW(object) + from, n); /* size = 1 */
+	break;
+    }
+
+    if(swap && size > 1) {
+	if (TYPEOF(object) == CPLXSXP)
+	    swapbn(buf, size/2, 2 * n);
+	else
+	    swapbn(buf, size, n);
+    }
+}
+
 /* writeBin(object, con, size, swap, useBytes) */
 SEXP attribute_hidden do_writebin(SEXP call, SEXP op, SEXP args, SEXP env)
 {
@@ -4548,110 +5112,32 @@ SEXP attribute_hidden do_writebin(SEXP call, SEXP op, SEXP args, SEXP env)
 	default:
 	    UNIMPLEMENTED_TYPE("writeBin", object);
 	}
-	char *buf = R_chk_calloc(len, size);
-	R_xlen_t j;
-	switch(TYPEOF(object)) {
-	case LGLSXP:
-	case INTSXP:
-	    switch (size) {
-	    case sizeof(int):
-		memcpy(buf, INTEGER(object), size * len);
-		break;
-#if SIZEOF_LONG == 8
-	    case sizeof(long):
-	    {
-		for (i = 0, j = 0; i < len; i++, j += size) {
-		    long l1 = (long) INTEGER(object)[i];
-		    memcpy(buf + j, &l1, size);
-		}
-		break;
-	    }
-#elif SIZEOF_LONG_LONG == 8
-	    case sizeof(_lli_t):
-	    {
-		for (i = 0, j = 0; i < len; i++, j += size) {
-		    _lli_t ll1 = (_lli_t) INTEGER(object)[i];
-		    memcpy(buf + j, &ll1, size);
-		}
-		break;
-	    }
-#endif
-	    case 2:
-	    {
-		for (i = 0, j = 0; i < len; i++, j += size) {
-		    short s1 = (short) INTEGER(object)[i];
-		    memcpy(buf + j, &s1, size);
-		}
-		break;
-	    }
-	    case 1:
-		for (i = 0; i < len; i++)
-		    /* compiler-defined conversion behavior */
-		    buf[i] = (signed char) INTEGER(object)[i];
-		break;
-	    default:
-		error(_("size %d is unknown on this machine"), size);
-	    }
-	    break;
-	case REALSXP:
-	    switch (size) {
-	    case sizeof(double):
-		memcpy(buf, REAL(object), size * len);
-		break;
-	    case sizeof(float):
-	    {
-		for (i = 0, j = 0; i < len; i++, j += size) {
-		    float f1 = (float) REAL(object)[i];
-		    memcpy(buf+j, &f1, size);
-		}
-		break;
-	    }
-#if HAVE_LONG_DOUBLE && (SIZEOF_LONG_DOUBLE > SIZEOF_DOUBLE)
-	    case sizeof(long double):
-	    {
-		/* some systems have problems with memcpy from
-		   the address of an automatic long double,
-		   e.g. ix86/x86_64 Linux with gcc4 */
-		static long double ld1;
-		for (i = 0, j = 0; i < len; i++, j += size) {
-		    ld1 = (long double) REAL(object)[i];
-		    memcpy(buf+j, &ld1, size);
-		}
-		break;
-	    }
-#endif
-	    default:
-		error(_("size %d is unknown on this machine"), size);
-	    }
-	    break;
-	case CPLXSXP:
-	    memcpy(buf, COMPLEX(object), size * len);
-	    break;
-	case RAWSXP:
-	    memcpy(buf, RAW(object), len); /* size = 1 */
-	    break;
-	}
-
-	if(swap && size > 1) {
-	    if (TYPEOF(object) == CPLXSXP)
-		for(i = 0; i < len; i++) {
-		    int sz = size/2;
-		    swapb(buf+sz*2*i, sz);
-		    swapb(buf+sz*(2*i+1), sz);
-		}
-	    else
-		for(i = 0; i < len; i++) swapb(buf+size*i, size);
-	}
-
-	/* write it now */
 	if(isRaw) { /* for non-long vectors, we checked size*len < 2^31-1 above */
 	    PROTECT(ans = allocVector(RAWSXP, size*len));
-	    memcpy(RAW(ans), buf, size*len);
-	} else {
-	    size_t nwrite = con->write(buf, size, len, con);
+	    binItems(object, 0, len, size, swap, (char *) RAW(ans));
+	} else if(!swap && size == nativeSize(object)) {
+	    /* write straight from the vector */
+	    const void *p = TYPEOF(object) == RAWSXP ? (void *) RAW(object)
+		: TYPEOF(object) == REALSXP ? (void *) REAL(object)
+		: TYPEOF(object) == CPLXSXP ? (void *) COMPLEX(object)
+		: (void *) INTEGER(object);
+	    size_t nwrite = con->write(p, size, len, con);
 	    if(nwrite < len) warning(_("problem writing to connection"));
+	} else {
+	    /* convert and write in blocks */
+	    const void *vmax = vmaxget();
+	    char *buf = R_alloc(BLOCK, size);
+	    for(i = 0; i < len; i += BLOCK) {
+		R_xlen_t n1 = (len - i < BLOCK) ? len - i : BLOCK;
+		binItems(object, i, n1, size, swap, buf);
+		size_t nwrite = con->write(buf, size, n1, con);
+		if(nwrite < n1) {
+		    warning(_("problem writing to connection"));
+		    break;
+		}
+	    }
+	    vmaxset(vmax);
 	}
-	Free(buf);
     }
 
     if(!wasopen) {
@@ -5544,6 +6030,9 @@ SEXP attribute_hidden do_url(SEXP call, SEXP op, SEXP args, SEXP env)
 			    { ztype = 2; subtype = 1;}
 			    if(!memcmp(buf, "]\0\0\200\0", 5))
 			    { ztype = 2; subtype = 1;}
+#ifdef HAVE_ZSTD
+			    if(is_zstd_magic(buf)) ztype = 3;
+#endif
 			}
 		    }
 		    switch(ztype) {
@@ -5559,6 +6048,9 @@ SEXP attribute_hidden do_url(SEXP call, SEXP op, SEXP args, SEXP env)
 		    case 2:
 			con = newxzfile(url, strlen(open) ? open : "rt", subtype, compress);
 			break;
+		    case 3:
+			con = newzstdfile(url, strlen(open) ? open : "rt", compress, 1);
+			break;
 		    }
 		} else
 		    con = newfile(url, ienc, strlen(open) ? open : "r", raw);
@@ -6362,6 +6854,76 @@ SEXP R_decompress3(SEXP in, Rboolean *err)
     return ans;
 }
 
+/* zstd, with type 'S' */
+attribute_hidden
+SEXP R_compress4(SEXP in)
+{
+#ifdef HAVE_ZSTD
+    const void *vmax = vmaxget();
+    unsigned int inlen;
+    size_t outlen, res;
+    char *buf;
+    SEXP ans;
+
+    if(TYPEOF(in) != RAWSXP)
+	error("R_compress4 requires a raw vector");
+    inlen = LENGTH(in);
+    outlen = ZSTD_compressBound(inlen);
+    buf = R_alloc(outlen + 5, sizeof(char));
+    /* we want this to be system-independent */
+    *((unsigned int *)buf) = (unsigned int) uiSwap(inlen);
+    buf[4] = 'S';
+    res = ZSTD_compress(buf + 5, outlen, (char *)RAW(in), inlen,
+			ZSTD_CLEVEL_DEFAULT);
+    if (ZSTD_isError(res))
+	error("internal error %s in R_compress4", ZSTD_getErrorName(res));
+    if (res > inlen) {
+	outlen = inlen;
+	buf[4] = '0';
+	memcpy(buf+5, (char *)RAW(in), inlen);
+    } else outlen = res;
+    ans = allocVector(RAWSXP, outlen + 5);
+    memcpy(RAW(ans), buf, outlen + 5);
+    vmaxset(vmax);
+    return ans;
+#else
+    error(_("zstd compression is not supported by this build of R"));
+    return R_NilValue; /* -Wall */
+#endif
+}
+
+attribute_hidden
+SEXP R_decompress4(SEXP in, Rboolean *err)
+{
+    const void *vmax = vmaxget();
+    unsigned char *p = RAW(in);
+    SEXP ans;
+
+    if(TYPEOF(in) != RAWSXP)
+	error("R_decompress4 requires a raw vector");
+    if (p[4] != 'S') return R_decompress3(in, err);
+#ifdef HAVE_ZSTD
+    unsigned int inlen = LENGTH(in),
+	outlen = (unsigned int) uiSwap(*((unsigned int *) p));
+    char *buf = R_alloc(outlen, sizeof(char));
+    size_t res = ZSTD_decompress(buf, outlen, p + 5, inlen - 5);
+    if (ZSTD_isError(res) || res != outlen) {
+	warning("internal error %s in R_decompress4",
+		ZSTD_isError(res) ? ZSTD_getErrorName(res) : "(size)");
+	*err = TRUE;
+	return R_NilValue;
+    }
+    ans = allocVector(RAWSXP, outlen);
+    memcpy(RAW(ans), buf, outlen);
+    vmaxset(vmax);
+    return ans;
+#else
+    warning(_("zstd compression is not supported by this build of R"));
+    *err = TRUE;
+    return R_NilValue;
+#endif
+}
+
 SEXP attribute_hidden
 do_memCompress(SEXP call, SEXP op, SEXP args, SEXP env)
 {
@@ -6437,6 +6999,22 @@ do_memCompress(SEXP call, SEXP op, SEXP args, SEXP env)
 	memcpy(RAW(ans), buf, outlen);
 	break;
     }
+    case 6: /* zstd */
+    {
+#ifdef HAVE_ZSTD
+	size_t inlen = XLENGTH(from), outlen = ZSTD_compressBound(inlen);
+	char *buf = R_alloc(outlen, sizeof(char));
+	size_t res = ZSTD_compress(buf, outlen, RAW(from), inlen,
+				   ZSTD_CLEVEL_DEFAULT);
+	if (ZSTD_isError(res))
+	    error("internal error %s in memCompress", ZSTD_getErrorName(res));
+	ans = allocVector(RAWSXP, res);
+	memcpy(RAW(ans), buf, res);
+#else
+	error(_("zstd compression is not supported by this build of R"));
+#endif
+	break;
+    }
     default:
 	break;
     }
@@ -6463,6 +7041,8 @@ do_memDecompress(SEXP call, SEXP op, SEXP args, SEXP env)
 	    type = 4; subtype = 1;
 	} else if(!memcmp(p, "]\0\0\200\0", 5)) {
 	    type = 4; subtype = 1;
+	} else if(XLENGTH(from) >= 4 && is_zstd_magic(p)) {
+	    type = 6;
 	} else {
 	    warning(_("unknown compression, assuming none"));
 	    type = 1;
@@ -6605,6 +7185,35 @@ do_memDecompress(SEXP call, SEXP op, SEXP args, SEXP env)
 	memcpy(RAW(ans), buf, outlen);
 	break;
     }
+    case 6: /* zstd */
+    {
+#ifdef HAVE_ZSTD
+	size_t inlen = XLENGTH(from), outlen = 3*inlen, res;
+	unsigned long long fsize = ZSTD_getFrameContentSize(RAW(from), inlen);
+	char *buf;
+	/* frames written by a streaming encoder may not record the size */
+	if (fsize != ZSTD_CONTENTSIZE_UNKNOWN &&
+	    fsize != ZSTD_CONTENTSIZE_ERROR && fsize > outlen)
+	    outlen = (size_t) fsize;
+	if (outlen == 0) outlen = 1;
+	while(1) {
+	    buf = R_alloc(outlen, sizeof(char));
+	    res = ZSTD_decompress(buf, outlen, RAW(from), inlen);
+	    if (ZSTD_isError(res) &&
+		ZSTD_getErrorCode(res) == ZSTD_error_dstSize_tooSmall) {
+		outlen *= 2; continue;
+	    }
+	    if (!ZSTD_isError(res)) break;
+	    error("internal error %s in memDecompress(%s)",
+		  ZSTD_getErrorName(res), "type = \"zstd\"");
+	}
+	ans = allocVector(RAWSXP, res);
+	memcpy(RAW(ans), buf, res);
+#else
+	error(_("zstd compression is not supported by this build of R"));
+#endif
+	break;
+    }
     default:
 	break;
     }
@@ -3927,19 +3927,40 @@ SEXP mkChar(const char *name)
 /* char_hash_size MUST be a power of 2 and char_hash_mask ==
    char_hash_size - 1 for x & char_hash_mask to be equivalent to x %
    char_hash_size.
+
+   Unlike environment hash tables, HASHPRI(R_StringHash) counts the
+   entries (not the primary slots used), and the table is doubled
+   when that exceeds its size, so that the chains stay short: it is
+   recounted when the GC removes unused CHARSXPs.
 */
 static unsigned int char_hash_size = 65536;
 static unsigned int char_hash_mask = 65535;
 
-static unsigned int char_hash(const char *s, int len)
+/* A multiplicative hash of 8 bytes at a time, with the final mixing
+   of MurmurHash3, so the low bits used for the index depend on all
+   the bytes.  This is several times faster on long strings than the
+   byte-at-a-time djb2 used previously. */
+static R_INLINE unsigned int char_hash(const char *s, int len)
 {
-    /* djb2 as from http://www.cse.yorku.ca/~oz/hash.html */
-    char *p;
-    int i;
-    unsigned int h = 5381;
-    for (p = (char *) s, i = 0; i < len; p++, i++)
-	h = ((h << 5) + h) + (*p);
-    return h;
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ (uint64_t) len, k;
+
+    for (; len >= 8; s += 8, len -= 8) {
+	memcpy(&k, s, 8);
+	k *= 0x87C37B91114253D5ULL;
+	h = (h ^ (k ^ (k >> 31))) * 0x4CF5AD432745937FULL;
+    }
+    if (len > 0) {
+	k = 0;
+	memcpy(&k, s, len);
+	k *= 0x87C37B91114253D5ULL;
+	h = (h ^ (k ^ (k >> 31))) * 0x4CF5AD432745937FULL;
+    }
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return (unsigned int) h;
 }
 
 void attribute_hidden InitStringHash()
@@ -3957,8 +3978,6 @@ static void R_StringHash_resize(unsigned int newsize)
     unsigned int counter, new_hashcode, newmask;
 #ifdef DEBUG_GLOBAL_STRING_HASH
     unsigned int oldsize = HASHSIZE(R_StringHash);
-    unsigned int oldpri = HASHPRI(R_StringHash);
-    unsigned int newsize, newpri;
 #endif
 
     /* Allocate the new hash table.  This could fail to allocate
@@ -3979,9 +3998,6 @@ static void R_StringHash_resize(unsigned int newsize)
 	    next = CXTAIL(chain);
 	    new_hashcode = char_hash(CHAR(val), LENGTH(val)) & newmask;
 	    new_chain = VECTOR_ELT(new_table, new_hashcode);
-	    /* If using a primary slot then increase HASHPRI */
-	    if (ISNULL(new_chain))
-		SET_HASHPRI(new_table, HASHPRI(new_table) + 1);
 	    /* move the current chain link to the new chain */
 	    /* this is a destrictive modification */
 	    new_chain = SET_CXTAIL(val, new_chain);
@@ -3989,17 +4005,54 @@ static void R_StringHash_resize(unsigned int newsize)
 	    chain = next;
 	}
     }
+    /* the entries have moved, so the GC may have changed the count */
+    SET_HASHPRI(new_table, HASHPRI(R_StringHash));
     R_StringHash = new_table;
     char_hash_size = newsize;
     char_hash_mask = newmask;
 #ifdef DEBUG_GLOBAL_STRING_HASH
-    newsize = HASHSIZE(new_table);
-    newpri = HASHPRI(new_table);
-    Rprintf("Resized: size %d => %d\tpri %d => %d\n",
-	    oldsize, newsize, oldpri, newpri);
+    Rprintf("Resized: size %d => %d\tentries %d\n",
+	    oldsize, HASHSIZE(new_table), HASHPRI(new_table));
 #endif
 }
 
+/* stringCache(): statistics on the CHARSXP cache */
+SEXP attribute_hidden do_stringcache(SEXP call, SEXP op, SEXP args, SEXP env)
+{
+    SEXP ans, nms;
+    double used = 0, entries = 0, maxlen = 0, probes = 0;
+
+    checkArity(op, args);
+    for (int i = 0; i < LENGTH(R_StringHash); i++) {
+	double len = 0;
+	for (SEXP chain = VECTOR_ELT(R_StringHash, i); !ISNULL(chain);
+	     chain = CXTAIL(chain))
+	    len++;
+	if (len > 0) used++;
+	if (len > maxlen) maxlen = len;
+	entries += len;
+	/* the k-th entry of a chain is found after k comparisons */
+	probes += len * (len + 1) / 2;
+    }
+    PROTECT(ans = allocVector(REALSXP, 6));
+    PROTECT(nms = allocVector(STRSXP, 6));
+    REAL(ans)[0] = LENGTH(R_StringHash);
+    REAL(ans)[1] = entries;
+    REAL(ans)[2] = entries / LENGTH(R_StringHash);
+    REAL(ans)[3] = used;
+    REAL(ans)[4] = maxlen;
+    REAL(ans)[5] = entries > 0 ? probes / entries : 0;
+    SET_STRING_ELT(nms, 0, mkChar("size"));
+    SET_STRING_ELT(nms, 1, mkChar("entries"));
+    SET_STRING_ELT(nms, 2, mkChar("load"));
+    SET_STRING_ELT(nms, 3, mkChar("slots.used"));
+    SET_STRING_ELT(nms, 4, mkChar("max.chain"));
+    SET_STRING_ELT(nms, 5, mkChar("mean.probes"));
+    setAttrib(ans, R_NamesSymbol, nms);
+    UNPROTECT(2);
+    return ans;
+}
+
 
 /* mkCharLenCE - make a character (CHARSXP) variable and set its
    encoding bit.  If a CHARSXP with the same string already exists in
@@ -4092,8 +4145,7 @@ SEXP mkCharLenCE(const char *name, int len, cetype_t enc)
 	SET_CACHED(cval);  /* Mark it */
 	/* add the new value to the cache */
 	chain = VECTOR_ELT(R_StringHash, hashcode);
-	if (ISNULL(chain))
-	    SET_HASHPRI(R_StringHash, HASHPRI(R_StringHash) + 1);
+	SET_HASHPRI(R_StringHash, HASHPRI(R_StringHash) + 1);
 	/* this is a destrictive modification */
 	chain = SET_CXTAIL(cval, chain);
 	SET_VECTOR_ELT(R_StringHash, hashcode, chain);
@@ -4103,7 +4155,7 @@ SEXP mkCharLenCE(const char *name, int len, cetype_t enc)
 	   Maximum possible power of two is 2^30 for a VECSXP.
 	   FIXME: this has changed with long vectors.
 	*/
-	if (R_HashSizeCheck(R_StringHash)
+	if ((unsigned int) HASHPRI(R_StringHash) > char_hash_size
 	    && char_hash_size < 1073741824 /* 2^30 */)
 	    R_StringHash_resize(char_hash_size * 2);
 
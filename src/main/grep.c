@@ -59,6 +59,7 @@ strsplit grep [g]sub [g]regexpr
 /* How many encoding warnings to give */
 #define NWARN 5
 
+#define R_USE_SIGNALS 1
 #include <Defn.h>
 #include <Internal.h>
 #include <R_ext/RS.h>  /* for Calloc/Free */
@@ -298,59 +299,305 @@ static long R_pcre_max_recursions()
 }
 #endif
 
+/* Compiled regular expressions are kept in a cache, most recently used
+   first: text processing often applies a few patterns to many short
+   inputs, one call at a time, and compiling a pattern (especially with
+   JIT) can take much longer than matching it.  Entries are keyed by the
+   pattern bytes, its kind and compile flags.  They depend on the locale
+   (PCRE character tables, TRE character classes) so Sys.setlocale()
+   flushes the cache.
+
+   An entry is not freed while in use: each call using it (including
+   nested ones, from a warning handler or a browser() there, say) holds
+   a pin on it.  The pin is dropped by rx_release() or, if the call is
+   left by a jump, by the cend of the context begun by rx_hold(). */
+
+typedef enum { RX_PCRE2, RX_TRE, RX_TREB, RX_TREW } rx_kind;
+
+typedef struct rx_entry {
+    struct rx_entry *prev, *next;
+    rx_kind kind;
+    int flags, pins;
+    unsigned int hash, gen;
+    size_t len;
+    char *key;
+    regex_t reg;
 #ifdef HAVE_PCRE2
-static void
+    pcre2_code *re;
+    const unsigned char *tables;
+    Rboolean jit;
+#endif
+} rx_entry;
+
+static rx_entry *rx_head = NULL, *rx_tail = NULL;
+static int rx_n = 0;
+static unsigned int rx_gen = 0;
+static double rx_hits = 0, rx_misses = 0, rx_evictions = 0;
+
+static unsigned int rx_hash(const char *key, size_t len, int flags)
+{
+    unsigned int h = 2166136261U ^ (unsigned int) flags;
+    for (size_t i = 0; i < len; i++)
+	h = (h ^ (unsigned char) key[i]) * 16777619U;
+    return h;
+}
+
+static R_INLINE Rboolean rx_busy(rx_entry *e)
+{
+    return e->pins > 0;
+}
+
+static void rx_free(rx_entry *e)
+{
+    if (e->prev) e->prev->next = e->next; else rx_head = e->next;
+    if (e->next) e->next->prev = e->prev; else rx_tail = e->prev;
+    rx_n--;
+#ifdef HAVE_PCRE2
+    if (e->kind == RX_PCRE2) {
+	pcre2_code_free(e->re);
+	/* new PCRE2 will have pcre2_maketables_free() */
+	if (e->tables) free((void *) e->tables);
+    } else
+#endif
+	tre_regfree(&e->reg);
+    free(e->key);
+    free(e);
+}
+
+/* free the least recently used entries beyond size, and stale ones */
+static void rx_trim(int size)
+{
+    rx_entry *e = rx_tail, *prev;
+    for (; e; e = prev) {
+	prev = e->prev;
+	if (rx_busy(e)) continue;
+	if (e->gen != rx_gen) rx_free(e);
+	else if (rx_n > size) {
+	    rx_free(e);
+	    rx_evictions++;
+	}
+    }
+}
+
+static void rx_front(rx_entry *e)
+{
+    if (e == rx_head) return;
+    e->prev->next = e->next;
+    if (e->next) e->next->prev = e->prev; else rx_tail = e->prev;
+    e->prev = NULL;
+    e->next = rx_head;
+    rx_head->prev = e;
+    rx_head = e;
+}
+
+static rx_entry *rx_find(rx_kind kind, int flags, const void *key,
+			 size_t len, unsigned int hash)
+{
+    for (rx_entry *e = rx_head; e; e = e->next)
+	if (e->hash == hash && e->kind == kind && e->flags == flags &&
+	    e->len == len && e->gen == rx_gen && !memcmp(e->key, key, len)) {
+	    rx_hits++;
+	    rx_front(e);
+	    return e;
+	}
+    rx_misses++;
+    return NULL;
+}
+
+/* a new entry, at the front, for a successfully compiled pattern */
+static rx_entry *rx_add(rx_kind kind, int flags, const void *key,
+			size_t len, unsigned int hash)
+{
+    rx_entry *e = malloc(sizeof(rx_entry));
+    char *k = malloc(len ? len : 1);
+    if (!e || !k) {
+	free(e);
+	free(k);
+	return NULL;
+    }
+    memcpy(k, key, len);
+    e->kind = kind;
+    e->flags = flags;
+    e->key = k;
+    e->len = len;
+    e->hash = hash;
+    e->gen = rx_gen;
+    e->pins = 0;
+    e->prev = NULL;
+    e->next = rx_head;
+    if (rx_head) rx_head->prev = e; else rx_tail = e;
+    rx_head = e;
+    rx_n++;
+    return e;
+}
+
+static void rx_unpin(void *data)
+{
+    rx_entry *e = data;
+    e->pins--;
+}
+
+/* Pin e, found or added by the caller with no R code run since, until
+   rx_release(e, cntxt). */
+static void rx_hold(rx_entry *e, RCNTXT *cntxt)
+{
+    e->pins++;
+    begincontext(cntxt, CTXT_CCODE, R_NilValue, R_BaseEnv, R_BaseEnv,
+		 R_NilValue, R_NilValue);
+    cntxt->cend = &rx_unpin;
+    cntxt->cenddata = e;
+}
+
+/* Called when a call has finished with e (but not on an error). */
+static void rx_release(rx_entry *e, RCNTXT *cntxt)
+{
+    endcontext(cntxt);
+    e->pins--;
+    rx_trim(R_RegexCacheSize);
+}
+
+attribute_hidden void R_FlushRegexCache(void)
+{
+    rx_gen++;
+    rx_trim(0);
+}
+
+/* after options(regex.cache.size =) */
+attribute_hidden void R_TrimRegexCache(void)
+{
+    rx_trim(R_RegexCacheSize);
+}
+
+/* Compile pattern as tre_regcomp(), tre_regcompb() or tre_regwcomp()
+   would (by kind), or find it in the cache.  Returns the error code, in
+   which case reg is for reg_report(). */
+static int R_tre_prepare(regex_t *reg, rx_entry **entry, rx_kind kind,
+			 const void *pattern, int cflags)
+{
+    size_t len = (kind == RX_TREW) ?
+	wcslen((const wchar_t *) pattern) * sizeof(wchar_t) :
+	strlen((const char *) pattern);
+    unsigned int hash = rx_hash(pattern, len, kind ^ (cflags << 2));
+    rx_entry *e = rx_find(kind, cflags, pattern, len, hash);
+    if (!e) {
+	regex_t r;
+	int rc;
+	if (kind == RX_TREW) rc = tre_regwcomp(&r, pattern, cflags);
+	else if (kind == RX_TREB) rc = tre_regcompb(&r, pattern, cflags);
+	else rc = tre_regcomp(&r, pattern, cflags);
+	if (rc) {
+	    *reg = r;
+	    return rc;
+	}
+	if (!(e = rx_add(kind, cflags, pattern, len, hash))) {
+	    tre_regfree(&r);
+	    error(_("allocation failure in regular expression cache"));
+	}
+	e->reg = r;
+    }
+    *reg = e->reg;
+    *entry = e;
+    return 0;
+}
+
+SEXP attribute_hidden do_regexcache(SEXP call, SEXP op, SEXP args, SEXP env)
+{
+    checkArity(op, args);
+    int reset = asLogical(CAR(args));
+    if (reset == NA_LOGICAL)
+	error(_("invalid '%s' argument"), "reset");
+    SEXP ans = PROTECT(allocVector(REALSXP, 5)), nms;
+    REAL(ans)[0] = R_RegexCacheSize;
+    REAL(ans)[1] = rx_n;
+    REAL(ans)[2] = rx_hits;
+    REAL(ans)[3] = rx_misses;
+    REAL(ans)[4] = rx_evictions;
+    nms = allocVector(STRSXP, 5);
+    setAttrib(ans, R_NamesSymbol, nms);
+    SET_STRING_ELT(nms, 0, mkChar("size"));
+    SET_STRING_ELT(nms, 1, mkChar("entries"));
+    SET_STRING_ELT(nms, 2, mkChar("hits"));
+    SET_STRING_ELT(nms, 3, mkChar("misses"));
+    SET_STRING_ELT(nms, 4, mkChar("evictions"));
+    if (reset) {
+	R_FlushRegexCache();
+	rx_hits = rx_misses = rx_evictions = 0;
+    }
+    UNPROTECT(1);
+    return ans;
+}
+
+#ifdef HAVE_PCRE2
+/* Returns the cache entry for the compiled pattern, and a match context
+   to be freed by the caller. */
+static rx_entry *
 R_pcre2_prepare(const char *pattern, SEXP subject, Rboolean use_UTF8,
-                Rboolean caseless, const unsigned char **tables,
-                pcre2_code **re, pcre2_match_context **mcontext)
+                Rboolean caseless, pcre2_code **re,
+                pcre2_match_context **mcontext)
 {
-    int errcode;
+    int errcode, flags = (use_UTF8 ? 1 : 0) | (caseless ? 2 : 0) |
+	(R_PCRE_use_JIT ? 4 : 0);
     PCRE2_SIZE erroffset;
     uint32_t options = 0;
     pcre2_compile_context *ccontext = NULL;
+    size_t len = strlen(pattern);
+    unsigned int hash = rx_hash(pattern, len, RX_PCRE2 ^ (flags << 2));
+    rx_entry *e = rx_find(RX_PCRE2, flags, pattern, len, hash);
+
+    if (!e) {
+	const unsigned char *tables = NULL;
+	pcre2_code *code;
+
+	if (use_UTF8)
+	    options |= PCRE2_UTF | PCRE2_NO_UTF_CHECK;
+	else {
+	    ccontext = pcre2_compile_context_create(NULL);
+	    /* PCRE2 internal tables by default are only for ASCII characters.
+	       They are needed for lower/upper case distinction and character
+	       classes in non-UTF mode. */
+	    tables = pcre2_maketables(NULL);
+	    pcre2_set_character_tables(ccontext, tables);
+	}
+	if (caseless)
+	    options |= PCRE2_CASELESS;
 
-    if (use_UTF8)
-	options |= PCRE2_UTF | PCRE2_NO_UTF_CHECK;
-    else {
-	ccontext = pcre2_compile_context_create(NULL);
-	/* PCRE2 internal tables by default are only for ASCII characters.
-	   They are needed for lower/upper case distinction and character
-	   classes in non-UTF mode. */
-	if (!*tables)
-	    *tables = pcre2_maketables(NULL);
-	pcre2_set_character_tables(ccontext, *tables);
-    }
-    if (caseless)
-	options |= PCRE2_CASELESS;
-
-    *re = pcre2_compile((PCRE2_SPTR) pattern, PCRE2_ZERO_TERMINATED, options,
-                         &errcode, &erroffset, ccontext);
-    if (!*re) {
-	/* not managing R_alloc stack because this ends in error */
-	char buf[256];
-	pcre2_get_error_message(errcode, (PCRE2_UCHAR *)buf, sizeof(buf));
+	code = pcre2_compile((PCRE2_SPTR) pattern, PCRE2_ZERO_TERMINATED,
+			     options, &errcode, &erroffset, ccontext);
 	pcre2_compile_context_free(ccontext);
-	warning(_("PCRE pattern compilation error\n\t'%s'\n\tat '%s'\n"), buf,
-	        to_native(pattern + erroffset, use_UTF8));
-	error(_("invalid regular expression '%s'"),
-	      to_native(pattern, use_UTF8));
-    }
-    pcre2_compile_context_free(ccontext);
-    *mcontext = pcre2_match_context_create(NULL);
-    if (R_PCRE_use_JIT) {
-	int rc = pcre2_jit_compile(*re, 0);
-	if (rc && rc != PCRE2_ERROR_JIT_BADOPTION) {
+	if (!code) {
+	    /* not managing R_alloc stack because this ends in error */
+	    char buf[256];
+	    pcre2_get_error_message(errcode, (PCRE2_UCHAR *)buf, sizeof(buf));
+	    if (tables) free((void *) tables);
+	    warning(_("PCRE pattern compilation error\n\t'%s'\n\tat '%s'\n"),
+		    buf, to_native(pattern + erroffset, use_UTF8));
+	    error(_("invalid regular expression '%s'"),
+		  to_native(pattern, use_UTF8));
+	}
+	int rc = R_PCRE_use_JIT ? pcre2_jit_compile(code, 0) : 1;
+	if (R_PCRE_use_JIT && rc && rc != PCRE2_ERROR_JIT_BADOPTION) {
 	    /* PCRE2_ERROR_JIT_BADOPTION is returned when JIT support is not
 	       compiled in PCRE2 library */
 	    char buf[256];
 	    pcre2_get_error_message(rc, (PCRE2_UCHAR *)buf, sizeof(buf));
+	    /* before adding the entry, as a handler may use the cache */
 	    warning(_("PCRE JIT compilation error\n\t'%s'"), buf);
 	}
-	if (!rc)
-	    setup_jit(*mcontext);
+	if (!(e = rx_add(RX_PCRE2, flags, pattern, len, hash))) {
+	    pcre2_code_free(code);
+	    if (tables) free((void *) tables);
+	    error(_("allocation failure in regular expression cache"));
+	}
+	e->re = code;
+	e->tables = tables;
+	e->jit = !rc;
     }
+    *re = e->re;
+    *mcontext = pcre2_match_context_create(NULL);
+    if (e->jit)
+	setup_jit(*mcontext);
 # ifdef R_PCRE_LIMIT_RECURSION
-    else if (use_recursion_limit(subject))
+    else if (!R_PCRE_use_JIT && use_recursion_limit(subject))
 	pcre2_set_recursion_limit(*mcontext, (uint32_t) R_pcre_max_recursions());
 
     /* we could use set_depth_limit() in newer versions, but the memory limit
@@ -358,6 +605,7 @@ R_pcre2_prepare(const char *pattern, SEXP subject, Rboolean use_UTF8,
        different meaning from those for recursion limit in versions before
        10.30 */
 # endif
+    return e;
 }
 #else /* ! HAVE_PCRE2 */
 static void
@@ -423,12 +671,181 @@ R_pcre_prepare(const char *pattern, SEXP subject, Rboolean use_UTF8,
 }
 #endif
 
+#ifdef HAVE_PCRE2
+/* With argument 'threads' > 1, grep(), grepl(), sub(), gsub() and
+   regexpr() match a PCRE2 pattern against long character vectors in
+   parallel.  The main thread gets the subjects of a block of elements
+   (translating them, as the serial code does), the threads match
+   contiguous parts of the block using their own match data and JIT
+   stack and without the R API, and then the main thread gives the
+   warnings and errors and builds the result, in the order of the
+   elements, so that all is as from the serial code. */
+
+#define RX_BLOCK 1024	/* elements per thread in a block */
+/* codes for the elements, besides pcre2_match() results */
+#define RX_INVALID INT_MIN	  /* invalid in the encoding */
+#define RX_TOOLONG (INT_MIN + 1)  /* sub() result too long */
+#define RX_NOMEM   (INT_MIN + 2)  /* sub() result cannot be allocated */
+
+typedef struct rx_par {
+    int threads, size, nb;	/* threads, block size, elements in block */
+    R_xlen_t base, n;		/* index of the block's first element; total */
+    pcre2_code *re;
+    pcre2_match_data **mdata;
+    pcre2_match_context **mcontext;
+    pcre2_jit_stack **jit;
+    Rboolean useBytes, use_UTF8;
+    const char **s;		/* subjects, NULL for NA */
+    int *code;			/* RX_* or the (last) pcre2_match() result */
+    int *ind;			/* grep: matches */
+    int *start, *len, *cstart, *clen, ncap; /* regexpr: as in the result */
+    const char *repl;		/* sub: replacement */
+    size_t replen;
+    Rboolean global;
+    char **out;			/* sub: results of R_pcre2_sub() */
+} rx_par;
+
+static void rx_par_free(void *data)
+{
+    rx_par *p = (rx_par *) data;
+    for (int t = 0; t < p->threads; t++) {
+	if (p->mdata && p->mdata[t]) pcre2_match_data_free(p->mdata[t]);
+	if (p->mcontext && p->mcontext[t])
+	    pcre2_match_context_free(p->mcontext[t]);
+	if (p->jit && p->jit[t]) pcre2_jit_stack_free(p->jit[t]);
+    }
+    if (p->out)
+	for (int k = 0; k < p->size; k++) free(p->out[k]);
+    free(p->mdata);
+    free(p->mcontext);
+    free(p->jit);
+    free(p->s);
+    free(p->code);
+    free(p->out);
+    p->mdata = NULL; p->mcontext = NULL; p->jit = NULL;
+    p->s = NULL; p->code = NULL; p->out = NULL;
+}
+
+/* Set up p for matching the pattern of entry e against n subjects with
+   up to 'threads' threads, copying the match context of the main
+   thread.  Returns FALSE if matching should be serial. */
+static Rboolean
+rx_par_init(rx_par *p, int threads, R_xlen_t n, rx_entry *e,
+	    pcre2_match_context *mcontext, uint32_t ovecsize, Rboolean sub)
+{
+    memset(p, 0, sizeof(rx_par));
+    if (threads < 2 || n <= RX_BLOCK) return FALSE;
+# ifdef R_PCRE_LIMIT_RECURSION
+    /* the recursion limit is for the C stack of the main thread */
+    if (!e->jit) return FALSE;
+# endif
+    if (n < (R_xlen_t) threads * RX_BLOCK)
+	threads = (int) ((n + RX_BLOCK - 1) / RX_BLOCK);
+    int stmax = e->jit ? jit_stack_size() : 0;
+    p->threads = threads;
+    p->size = threads * RX_BLOCK;
+    p->n = n;
+    p->re = e->re;
+    p->mdata = calloc(threads, sizeof(pcre2_match_data *));
+    p->mcontext = calloc(threads, sizeof(pcre2_match_context *));
+    p->jit = calloc(threads, sizeof(pcre2_jit_stack *));
+    p->s = malloc(p->size * sizeof(char *));
+    p->code = malloc(p->size * sizeof(int));
+    if (sub) p->out = calloc(p->size, sizeof(char *));
+    if (!p->mdata || !p->mcontext || !p->jit || !p->s || !p->code ||
+	(sub && !p->out)) {
+	rx_par_free(p);
+	return FALSE;
+    }
+    for (int t = 0; t < threads; t++) {
+	p->mdata[t] = pcre2_match_data_create(ovecsize, NULL);
+	p->mcontext[t] = pcre2_match_context_copy(mcontext);
+	if (e->jit) {
+	    p->jit[t] = pcre2_jit_stack_create(32*1024, stmax, NULL);
+	    if (p->jit[t] && p->mcontext[t])
+		pcre2_jit_stack_assign(p->mcontext[t], NULL, p->jit[t]);
+	}
+	if (!p->mdata[t] || !p->mcontext[t] || (e->jit && !p->jit[t])) {
+	    rx_par_free(p);
+	    return FALSE;
+	}
+    }
+    return TRUE;
+}
+
+/* Get the subjects of the next block of text (on the R_alloc stack),
+   returning FALSE if there are none. */
+static Rboolean rx_par_next(rx_par *p, SEXP text)
+{
+    p->base += p->nb;
+    if (p->base >= p->n) return FALSE;
+    p->nb = (p->n - p->base < p->size) ? (int) (p->n - p->base) : p->size;
+    for (int k = 0; k < p->nb; k++) {
+	SEXP el = STRING_ELT(text, p->base + k);
+	if (el == NA_STRING) p->s[k] = NULL;
+	else if (p->useBytes) p->s[k] = CHAR(el);
+	else if (p->use_UTF8) p->s[k] = translateCharUTF8(el);
+	else p->s[k] = translateChar(el);
+    }
+    return TRUE;
+}
+
+static R_INLINE Rboolean rx_par_valid(rx_par *p, const char *s)
+{
+    if (p->useBytes) return TRUE;
+    else if (p->use_UTF8) return utf8Valid(s);
+    else return !mbcslocale || mbcsValid(s);
+}
+
+/* Match the block, thread t taking elements from to to-1 */
+static void
+rx_par_run(rx_par *p, void (*match)(rx_par *p, int t, int from, int to))
+{
+    int per = (p->nb + p->threads - 1) / p->threads;
+#ifdef _OPENMP
+# pragma omp parallel for num_threads(p->threads) schedule(static)
+#endif
+    for (int t = 0; t < p->threads; t++) {
+	int from = t * per, to = (from + per < p->nb) ? from + per : p->nb;
+	if (from < to) match(p, t, from, to);
+    }
+}
+
+/* The context for matching in blocks, to free p on error: its call is
+   that for warnings and errors from the serial code. */
+static void rx_par_begin(RCNTXT *cntxt, rx_par *p)
+{
+    begincontext(cntxt, CTXT_CCODE, R_GlobalContext->call, R_BaseEnv,
+		 R_BaseEnv, R_NilValue, R_NilValue);
+    cntxt->cend = &rx_par_free;
+    cntxt->cenddata = p;
+}
+#endif
+
 // FIXME: Protect PCRE/PCRE2 data via contexts (as well as other data).
 // FIXME: Do not rebuild locale tables repeatedly.
 // FIXME: There is no documented way to free locale tables with PCRE2.
 //        Using free() would not work on Windows if PCRE2 is dynamically
 //        linked but uses a different C runtime from R.
 
+/* Find the first occurrence of the plen > 0 bytes of pat in the len
+   bytes of target, or NULL.  Candidates are found by memchr() for the
+   first byte, which C libraries vectorize, so this runs at close to
+   memory speed unless that byte is very common in target. */
+static R_INLINE const char *
+fsearch(const char *pat, size_t plen, const char *target, size_t len)
+{
+    const char *p = target, *end;
+
+    if (plen > len) return NULL;
+    end = target + len - plen + 1; /* one past the last possible start */
+    while ((p = memchr(p, pat[0], end - p)) != NULL) {
+	if (memcmp(p + 1, pat + 1, plen - 1) == 0) return p;
+	if (++p >= end) break;
+    }
+    return NULL;
+}
+
 /* strsplit is going to split the strings in the first argument into
  * tokens depending on the second argument. The characters of the second
  * argument are used to split the first argument.  A list of vectors is
@@ -444,7 +861,9 @@ SEXP attribute_hidden do_strsplit(SEXP call, SEXP op, SEXP args, SEXP env)
     int fixed_opt, perl_opt, useBytes;
     char *pt = NULL; wchar_t *wpt = NULL;
     const char *buf, *split = "", *bufp;
+#ifndef HAVE_PCRE2
     const unsigned char *tables = NULL;
+#endif
     Rboolean use_UTF8 = FALSE, haveBytes = FALSE;
     const void *vmax, *vmax2;
     int nwarn = 0;
@@ -632,45 +1051,25 @@ SEXP attribute_hidden do_strsplit(SEXP call, SEXP op, SEXP args, SEXP env)
 		/* find out how many splits there will be */
 		size_t ntok = 0;
 		/* This is UTF-8 safe since it compares whole strings */
-		laststart = buf;
 		ebuf = buf + strlen(buf);
-		for (bufp = buf; bufp < ebuf; bufp++) {
-		    if ((slen == 1 && *bufp != *split) ||
-			(slen > 1 && strncmp(bufp, split, slen))) continue;
+		for (bufp = buf;
+		     (laststart = fsearch(split, slen, bufp, ebuf - bufp));
+		     bufp = laststart + slen)
 		    ntok++;
-		    bufp += MAX(slen - 1, 0);
-		    laststart = bufp+1;
-		}
-		bufp = laststart;
 		SET_VECTOR_ELT(ans, i,
 			       t = allocVector(STRSXP, ntok + (*bufp ? 1 : 0)));
 		/* and fill with the splits */
-		laststart = bufp = buf;
+		bufp = buf;
 		pt = Realloc(pt, strlen(buf)+1, char);
 		for (size_t j = 0; j < ntok; j++) {
-		    /* This is UTF-8 safe since it compares whole
-		       strings, but <MBCS-FIXME> it would be more
-		       efficient to skip along by chars.
-		    */
-		    for (; bufp < ebuf; bufp++) {
-			if ((slen == 1 && *bufp != *split) ||
-			    (slen > 1 && strncmp(bufp, split, slen))) continue;
-			if (slen) {
-			    if (bufp > laststart)
-				strncpy(pt, laststart, bufp - laststart);
-			    pt[bufp - laststart] = '\0';
-			} else {
-			    pt[0] = *bufp; pt[1] ='\0';
-			}
-			bufp += MAX(slen-1, 0);
-			laststart = bufp+1;
-			if (use_UTF8)
-			    SET_STRING_ELT(t, j, mkCharCE(pt, CE_UTF8));
-			else
-			    SET_STRING_ELT(t, j, markKnown(pt, STRING_ELT(x, i)));
-			break;
-		    }
-		    bufp = laststart;
+		    laststart = fsearch(split, slen, bufp, ebuf - bufp);
+		    memcpy(pt, bufp, laststart - bufp);
+		    pt[laststart - bufp] = '\0';
+		    bufp = laststart + slen;
+		    if (use_UTF8)
+			SET_STRING_ELT(t, j, mkCharCE(pt, CE_UTF8));
+		    else
+			SET_STRING_ELT(t, j, markKnown(pt, STRING_ELT(x, i)));
 		}
 		if (*bufp) {
 		    if (use_UTF8)
@@ -697,7 +1096,10 @@ SEXP attribute_hidden do_strsplit(SEXP call, SEXP op, SEXP args, SEXP env)
 	    pcre2_match_context *mcontext = NULL;
 	    PCRE2_SIZE *ovector = NULL;
 	    uint32_t ovecsize = 10;
-	    R_pcre2_prepare(split, x, use_UTF8, FALSE, &tables, &re, &mcontext);
+	    RCNTXT rxcntxt;
+	    rx_entry *rxe = R_pcre2_prepare(split, x, use_UTF8, FALSE, &re,
+					    &mcontext);
+	    rx_hold(rxe, &rxcntxt);
 	    pcre2_match_data *mdata = pcre2_match_data_create(ovecsize, NULL);
 #else
 	    pcre *re_pcre = NULL;
@@ -801,14 +1203,16 @@ SEXP attribute_hidden do_strsplit(SEXP call, SEXP op, SEXP args, SEXP env)
 	    }
 #ifdef HAVE_PCRE2
 	    pcre2_match_data_free(mdata);
-	    pcre2_code_free(re);
 	    pcre2_match_context_free(mcontext);
+	    rx_release(rxe, &rxcntxt);
 #else
 	    if(re_pe) pcre_free_study(re_pe);
 	    pcre_free(re_pcre);
 #endif
 	} else if (!useBytes && use_UTF8) { /* ERE in wchar_t */
 	    regex_t reg;
+	    rx_entry *rxe;
+	    RCNTXT rxcntxt;
 	    regmatch_t regmatch[1];
 	    int rc;
 	    int cflags = REG_EXTENDED;
@@ -822,8 +1226,9 @@ SEXP attribute_hidden do_strsplit(SEXP call, SEXP op, SEXP args, SEXP env)
 	    */
 
 	    wsplit = wtransChar(STRING_ELT(tok, itok));
-	    if ((rc = tre_regwcomp(&reg, wsplit, cflags)))
+	    if ((rc = R_tre_prepare(&reg, &rxe, RX_TREW, wsplit, cflags)))
 		reg_report(rc, &reg, translateChar(STRING_ELT(tok, itok)));
+	    rx_hold(rxe, &rxcntxt);
 
 	    vmax2 = vmaxget();
 	    for (i = itok; i < len; i += tlen) {
@@ -872,9 +1277,11 @@ SEXP attribute_hidden do_strsplit(SEXP call, SEXP op, SEXP args, SEXP env)
 				   mkCharWLen(wbufp, (int) wcslen(wbufp)));
 		vmaxset(vmax2);
 	    }
-	    tre_regfree(&reg);
+	    rx_release(rxe, &rxcntxt);
 	} else { /* ERE in normal chars -- single byte or MBCS */
 	    regex_t reg;
+	    rx_entry *rxe;
+	    RCNTXT rxcntxt;
 	    regmatch_t regmatch[1];
 	    int rc;
 	    int cflags = REG_EXTENDED;
@@ -893,8 +1300,9 @@ SEXP attribute_hidden do_strsplit(SEXP call, SEXP op, SEXP args, SEXP env)
 		if (mbcslocale && !mbcsValid(split))
 		    error(_("'split' string %d is invalid in this locale"), itok+1);
 	    }
-	    if ((rc = tre_regcomp(&reg, split, cflags)))
+	    if ((rc = R_tre_prepare(&reg, &rxe, RX_TRE, split, cflags)))
 		reg_report(rc, &reg, split);
+	    rx_hold(rxe, &rxcntxt);
 
 	    vmax2 = vmaxget();
 	    for (i = itok; i < len; i += tlen) {
@@ -960,7 +1368,7 @@ SEXP attribute_hidden do_strsplit(SEXP call, SEXP op, SEXP args, SEXP env)
 		    SET_STRING_ELT(t, ntok, markKnown(bufp, STRING_ELT(x, i)));
 		vmaxset(vmax2);
 	    }
-	    tre_regfree(&reg);
+	    rx_release(rxe, &rxcntxt);
 	}
 	vmaxset(vmax);
     }
@@ -969,128 +1377,157 @@ SEXP attribute_hidden do_strsplit(SEXP call, SEXP op, SEXP args, SEXP env)
 	namesgets(ans, getAttrib(x, R_NamesSymbol));
     UNPROTECT(1);
     Free(pt); Free(wpt);
-#ifdef HAVE_PCRE2
-    if (tables) free((void *)tables);
-    /* new PCRE2 will have pcre2_maketables_free() */
-#else
+#ifndef HAVE_PCRE2
     if (tables) pcre_free((void *)tables);
 #endif
     UNPROTECT(1); /* tok */
     return ans;
 }
 
+/* The byte position of the first match of pat in target which starts
+   at a character boundary.  UTF-8 is self-synchronizing, so in valid
+   UTF-8 (which the callers have checked) any byte match will do, as
+   it will in ASCII in any locale: only in other multibyte locales do
+   we need to skip along by chars, and then only if there is a byte
+   match at all. */
+static int fgrep_bytepos(const char *pat, size_t plen,
+			 const char *target, size_t len,
+			 Rboolean useBytes, Rboolean use_UTF8)
+{
+    const char *p = fsearch(pat, plen, target, len);
+
+    if (p == NULL) return -1;
+    if (useBytes || use_UTF8 || !mbcslocale || utf8locale)
+	return (int) (p - target);
+    /* Skip along by chars from the start, as Mbrtowc needs: p is
+       the first candidate, so the earlier bytes need not be compared */
+    mbstate_t mb_st;
+    int ib, used;
+    mbs_init(&mb_st);
+    for (ib = 0; ib <= (int) (len - plen); ib += used) {
+	if (target + ib >= p && strncmp(pat, target + ib, plen) == 0)
+	    return ib;
+	used = (int) Mbrtowc(NULL, target + ib, MB_CUR_MAX, &mb_st);
+	if (used <= 0) break;
+    }
+    return -1;
+}
+
 /* Used by grep[l] and [g]regexpr, with return value the match
    position in characters */
-/* This could be faster for plen > 1, but uses in R are for small strings */
 static int fgrep_one(const char *pat, const char *target,
 		     Rboolean useBytes, Rboolean use_UTF8, int *next)
 {
-    int plen = (int) strlen(pat), len = (int) strlen(target);
-    int i = -1;
-    const char *p;
+    size_t plen = strlen(pat), len = strlen(target);
+    int ib, i;
 
     if (plen == 0) {
 	if (next != NULL) *next = 1;
 	return 0;
     }
-    if (plen == 1 && (useBytes || !(mbcslocale || use_UTF8))) {
-	/* a single byte is a common case */
-	for (i = 0, p = target; *p; p++, i++)
-	    if (*p == pat[0]) {
-		if (next != NULL) *next = i + 1;
-		return i;
-	    }
+    if ((ib = fgrep_bytepos(pat, plen, target, len, useBytes, use_UTF8)) < 0)
 	return -1;
-    }
-    if (!useBytes && use_UTF8) {
-        int ib, used;
-	for (ib = 0, i = 0; ib <= len-plen; i++) {
-	    if (strncmp(pat, target+ib, plen) == 0) {
-		if (next != NULL) *next = ib + plen;
-		return i;
-	    }
-	    used = utf8clen(target[ib]);
-	    if (used <= 0) break;
-	    ib += used;
-	}
-    } else if (!useBytes && mbcslocale) { /* skip along by chars */
+    if (next != NULL) *next = ib + (int) plen;
+    if (useBytes || !(mbcslocale || use_UTF8)) return ib;
+    if (use_UTF8 || utf8locale) {
+	/* count the chars before the match by their lead bytes */
+	int nc = 0;
+	for (i = 0; i < ib; i += utf8clen(target[i])) nc++;
+	return nc;
+    } else {
 	mbstate_t mb_st;
-	int ib, used;
+	int nc = 0;
 	mbs_init(&mb_st);
-	for (ib = 0, i = 0; ib <= len-plen; i++) {
-	    if (strncmp(pat, target+ib, plen) == 0) {
-		if (next != NULL) *next = ib + plen;
-		return i;
-	    }
-	    used = (int) Mbrtowc(NULL,  target+ib, MB_CUR_MAX, &mb_st);
-	    if (used <= 0) break;
-	    ib += used;
-	}
-    } else
-	for (i = 0; i <= len-plen; i++)
-	    if (strncmp(pat, target+i, plen) == 0) {
-		if (next != NULL) *next = i + plen;
-		return i;
-	    }
-    return -1;
+	for (i = 0; i < ib; nc++)
+	    i += (int) Mbrtowc(NULL, target + i, MB_CUR_MAX, &mb_st);
+	return nc;
+    }
 }
 
 /* Returns the match position in bytes, for use in [g]sub.
    len is the length of target.
 */
-
 static int fgrep_one_bytes(const char *pat, const char *target, int len,
 			   Rboolean useBytes, Rboolean use_UTF8)
 {
-    int i = -1, plen = (int) strlen(pat);
-    const char *p;
+    size_t plen = strlen(pat);
 
     if (plen == 0) return 0;
-    if (plen == 1 && (useBytes || !(mbcslocale || use_UTF8))) {
-	/* a single byte is a common case */
-	for (i = 0, p = target; *p; p++, i++)
-	    if (*p == pat[0]) return i;
-	return -1;
+    return fgrep_bytepos(pat, plen, target, len, useBytes, use_UTF8);
+}
+
+#ifdef HAVE_PCRE2
+static void grep_match(rx_par *p, int t, int from, int to)
+{
+    for (int k = from; k < to; k++) {
+	const char *s = p->s[k];
+	if (!s) p->code[k] = 0;
+	else if (!rx_par_valid(p, s)) p->code[k] = RX_INVALID;
+	else
+	    p->code[k] = pcre2_match(p->re, (PCRE2_SPTR) s,
+				     PCRE2_ZERO_TERMINATED, 0, 0,
+				     p->mdata[t], p->mcontext[t]);
     }
-    if (!useBytes && use_UTF8) { /* not really needed */
-	int ib, used;
-	for (ib = 0, i = 0; ib <= len-plen; i++) {
-	    if (strncmp(pat, target+ib, plen) == 0) return ib;
-	    used = utf8clen(target[ib]);
-	    if (used <= 0) break;
-	    ib += used;
-	}
-    } else if (!useBytes && mbcslocale) { /* skip along by chars */
-	mbstate_t mb_st;
-	int ib, used;
-	mbs_init(&mb_st);
-	for (ib = 0, i = 0; ib <= len-plen; i++) {
-	    if (strncmp(pat, target+ib, plen) == 0) return ib;
-	    used = (int) Mbrtowc(NULL, target+ib, MB_CUR_MAX, &mb_st);
-	    if (used <= 0) break;
-	    ib += used;
+}
+
+/* grep() in parallel, filling ind and returning the number of matches
+   as the serial code does */
+static R_xlen_t grep_par(rx_par *p, SEXP text, int *ind, int invert)
+{
+    RCNTXT cntxt;
+    const void *vmax = vmaxget();
+    R_xlen_t i, nmatches = 0;
+    int nwarn = 0;
+
+    rx_par_begin(&cntxt, p);
+    while (rx_par_next(p, text)) {
+	rx_par_run(p, grep_match);
+	for (int k = 0; k < p->nb; k++) {
+	    i = p->base + k;
+	    ind[i] = 0;
+	    if (p->s[k]) {
+		int rc = p->code[k];
+		if (rc == RX_INVALID) {
+		    if(nwarn++ < NWARN) {
+			if (p->use_UTF8)
+			    warning(_("input string %d is invalid UTF-8"), (int) (i+1));
+			else
+			    warning(_("input string %d is invalid in this locale"), (int) (i+1));
+		    }
+		    continue;
+		}
+		if (rc >= 0) ind[i] = 1;
+		else R_pcre_exec_error(rc, i);
+	    }
+	    if (invert ^ ind[i]) nmatches++;
 	}
-    } else
-	for (i = 0; i <= len-plen; i++)
-	    if (strncmp(pat, target+i, plen) == 0) return i;
-    return -1;
+	vmaxset(vmax);
+	R_CheckUserInterrupt();
+    }
+    endcontext(&cntxt);
+    rx_par_free(p);
+    return nmatches;
 }
+#endif
 
 SEXP attribute_hidden do_grep(SEXP call, SEXP op, SEXP args, SEXP env)
 {
     SEXP pat, text, ind, ans;
     regex_t reg;
+    rx_entry *rxe = NULL;
+    RCNTXT rxcntxt;
     R_xlen_t i, j, n;
     int nmatches = 0, rc;
-    int igcase_opt, value_opt, perl_opt, fixed_opt, useBytes, invert;
+    int igcase_opt, value_opt, perl_opt, fixed_opt, useBytes, invert, threads;
     const char *spat = NULL;
-    const unsigned char *tables = NULL /* -Wall */;
 #ifdef HAVE_PCRE2
     pcre2_code *re = NULL;
     pcre2_match_context *mcontext = NULL;
     uint32_t ovecsize = 1;
     pcre2_match_data *mdata = NULL;
+    rx_par par;
 #else
+    const unsigned char *tables = NULL /* -Wall */;
     pcre *re_pcre = NULL /* -Wall */;
     pcre_extra *re_pe = NULL;
     int ovecsize = 3;
@@ -1108,13 +1545,16 @@ SEXP attribute_hidden do_grep(SEXP call, SEXP op, SEXP args, SEXP env)
     perl_opt = asLogical(CAR(args)); args = CDR(args);
     fixed_opt = asLogical(CAR(args)); args = CDR(args);
     useBytes = asLogical(CAR(args)); args = CDR(args);
-    invert = asLogical(CAR(args));
+    invert = asLogical(CAR(args)); args = CDR(args);
+    threads = asInteger(CAR(args));
     if (igcase_opt == NA_INTEGER) igcase_opt = 0;
     if (value_opt == NA_INTEGER) value_opt = 0;
     if (perl_opt == NA_INTEGER) perl_opt = 0;
     if (fixed_opt == NA_INTEGER) fixed_opt = 0;
     if (useBytes == NA_INTEGER) useBytes = 0;
     if (invert == NA_INTEGER) invert = 0;
+    if (threads == NA_INTEGER || threads < 1)
+	error(_("invalid '%s' argument"), "threads");
     if (fixed_opt && igcase_opt)
 	warning(_("argument '%s' will be ignored"), "ignore.case = TRUE");
     if (fixed_opt && perl_opt) {
@@ -1205,8 +1645,9 @@ SEXP attribute_hidden do_grep(SEXP call, SEXP op, SEXP args, SEXP env)
     if (fixed_opt) ;
     else if (perl_opt) {
 #ifdef HAVE_PCRE2
-	R_pcre2_prepare(spat, text, use_UTF8, igcase_opt, &tables, &re,
-	                &mcontext);
+	rxe = R_pcre2_prepare(spat, text, use_UTF8, igcase_opt, &re,
+			      &mcontext);
+	rx_hold(rxe, &rxcntxt);
 	mdata = pcre2_match_data_create(ovecsize, NULL);
 #else
 	R_pcre_prepare(spat, text, use_UTF8, igcase_opt, FALSE, &tables,
@@ -1216,14 +1657,24 @@ SEXP attribute_hidden do_grep(SEXP call, SEXP op, SEXP args, SEXP env)
 	int cflags = REG_NOSUB | REG_EXTENDED;
 	if (igcase_opt) cflags |= REG_ICASE;
 	if (!use_WC)
-	    rc = tre_regcompb(&reg, spat, cflags);
+	    rc = R_tre_prepare(&reg, &rxe, RX_TREB, spat, cflags);
 	else
-	    rc = tre_regwcomp(&reg, wtransChar(STRING_ELT(pat, 0)), cflags);
+	    rc = R_tre_prepare(&reg, &rxe, RX_TREW,
+			       wtransChar(STRING_ELT(pat, 0)), cflags);
 	if (rc) reg_report(rc, &reg, spat);
+	rx_hold(rxe, &rxcntxt);
     }
 
     PROTECT(ind = allocVector(LGLSXP, n));
     vmax = vmaxget();
+#ifdef HAVE_PCRE2
+    if (perl_opt && rx_par_init(&par, threads, n, rxe, mcontext, ovecsize,
+				FALSE)) {
+	par.useBytes = useBytes;
+	par.use_UTF8 = use_UTF8;
+	nmatches = (int) grep_par(&par, text, LOGICAL(ind), invert);
+    } else
+#endif
     for (i = 0 ; i < n ; i++) {
 //	if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
 	LOGICAL(ind)[i] = 0;
@@ -1249,7 +1700,9 @@ SEXP attribute_hidden do_grep(SEXP call, SEXP op, SEXP args, SEXP env)
 	    }
 
 	    if (fixed_opt)
-		LOGICAL(ind)[i] = fgrep_one(spat, s, useBytes, use_UTF8, NULL) >= 0;
+		/* only whether there is a match, not where in chars */
+		LOGICAL(ind)[i] = fgrep_one_bytes(spat, s, (int) strlen(s),
+						  useBytes, use_UTF8) >= 0;
 	    else if (perl_opt) {
 #ifdef HAVE_PCRE2
 		int rc = pcre2_match(re, (PCRE2_SPTR) s, PCRE2_ZERO_TERMINATED,
@@ -1284,18 +1737,15 @@ SEXP attribute_hidden do_grep(SEXP call, SEXP op, SEXP args, SEXP env)
     else if (perl_opt) {
 #ifdef HAVE_PCRE2
 	pcre2_match_data_free(mdata);
-	pcre2_code_free(re);
 	pcre2_match_context_free(mcontext);
-	if (tables)
-	    /* new PCRE2 will have pcre2_maketables_free() */
-	    free((void *)tables);
+	rx_release(rxe, &rxcntxt);
 #else
 	if (re_pe) pcre_free_study(re_pe);
 	pcre_free(re_pcre);
 	pcre_free((void *)tables);
 #endif
     } else
-	tre_regfree(&reg);
+	rx_release(rxe, &rxcntxt);
 
     if (PRIMVAL(op)) {/* grepl case */
 	UNPROTECT(1); /* ind */
@@ -1832,6 +2282,191 @@ char *R_pcre_string_adj(char *target, const char *orig, const char *repl,
     return t;
 }
 
+#ifdef HAVE_PCRE2
+/* Replace the first (or with global, every) match of re in s by repl,
+   of length replen.  Returns a malloc-ed string, or NULL if there was
+   no match or on error: *rc is set to the last pcre2_match() result,
+   or to RX_TOOLONG or RX_NOMEM.  Uses no R API unless use_UTF8 and repl
+   changes case, see changes_case(). */
+static char *
+R_pcre2_sub(pcre2_code *re, const char *s, const char *repl, size_t replen,
+	    Rboolean global, Rboolean use_UTF8, pcre2_match_data *mdata,
+	    pcre2_match_context *mcontext, int *rc)
+{
+    int j, ns, nns, maxrep, offset = 0, nmatch = 0, last_end = -1, ncap;
+    uint32_t eflag = 0;
+    PCRE2_SIZE *ovector = NULL;
+    char *u, *cbuf, *tmp;
+
+    ns = (int) strlen(s);
+    /* worst possible scenario is to put a copy of the
+       replacement after every character, unless there are
+       backrefs */
+    maxrep = (int)(replen + (ns-2) * count_subs(repl));
+    if (global) {
+	/* Integer overflow has been seen */
+	double dnns = ns * (maxrep + 1.) + 1000;
+	if (dnns > 10000) dnns = (double)(2*ns + replen + 1000);
+	nns = (int) dnns;
+    } else nns = ns + maxrep + 1000;
+    if (!(u = cbuf = malloc(nns))) {
+	*rc = RX_NOMEM;
+	return NULL;
+    }
+    /* ncap is one more than the number of capturing patterns */
+    /* PCRE2 has also pcre2_substitute */
+    while ((ncap = pcre2_match(re, (PCRE2_SPTR) s, (PCRE2_SIZE) ns,
+			       (PCRE2_SIZE) offset, eflag, mdata,
+			       mcontext)) >= 0 ) {
+	ovector = pcre2_get_ovector_pointer(mdata);
+	nmatch++;
+	for (j = offset; j < ovector[0]; j++) *u++ = s[j];
+	if (last_end == -1 /* for PCRE2 */ || ovector[1] > last_end) {
+	    u = R_pcre_string_adj(u, s, repl, ovector, use_UTF8, ncap);
+	    last_end = (int) ovector[1];
+	}
+	offset = (int) ovector[1];
+	if (s[offset] == '\0' || !global) break;
+	if (ovector[1] == ovector[0]) {
+	    /* advance by a char */
+	    if (use_UTF8) {
+		int used, pos = 0;
+		while( (used = utf8clen(s[pos])) ) {
+		    pos += used;
+		    if (pos > offset) {
+			for (j = offset; j < pos; j++) *u++ = s[j];
+			offset = pos;
+			break;
+		    }
+		}
+	    } else
+		*u++ = s[offset++];
+	}
+	if (nns < (u - cbuf) + (ns-offset) + maxrep + 100) {
+	    if (nns > INT_MAX/2) {
+		free(cbuf);
+		*rc = RX_TOOLONG;
+		return NULL;
+	    }
+	    nns *= 2;
+	    if (!(tmp = realloc(cbuf, nns))) {
+		free(cbuf);
+		*rc = RX_NOMEM;
+		return NULL;
+	    }
+	    u = tmp + (u - cbuf);
+	    cbuf = tmp;
+	}
+	eflag = PCRE2_NOTBOL;  /* probably not needed */
+    }
+    *rc = ncap;
+    if (nmatch == 0) {
+	free(cbuf);
+	return NULL;
+    }
+    /* copy the tail */
+    if (nns < (u - cbuf) + (ns-offset)+1) {
+	if (nns > INT_MAX/2) {
+	    free(cbuf);
+	    *rc = RX_TOOLONG;
+	    return NULL;
+	}
+	nns *= 2;
+	if (!(tmp = realloc(cbuf, nns))) {
+	    free(cbuf);
+	    *rc = RX_NOMEM;
+	    return NULL;
+	}
+	u = tmp + (u - cbuf);
+	cbuf = tmp;
+    }
+    for (j = offset ; s[j] ; j++) *u++ = s[j];
+    *u = '\0';
+    return cbuf;
+}
+
+/* Set element i of ans from the result cbuf and code rc of
+   R_pcre2_sub(), freeing cbuf. */
+static void
+R_pcre2_sub_set(SEXP ans, R_xlen_t i, SEXP text, SEXP rep, char *cbuf,
+		int rc, Rboolean useBytes, Rboolean use_UTF8)
+{
+    if (rc == RX_TOOLONG) error(_("result string is too long"));
+    if (rc == RX_NOMEM) error(_("cannot allocate the result string"));
+    R_pcre_exec_error(rc, i);
+    if (!cbuf) {
+	SET_STRING_ELT(ans, i, STRING_ELT(text, i));
+	return;
+    }
+    if (STRING_ELT(rep, 0) == NA_STRING)
+	SET_STRING_ELT(ans, i, NA_STRING);
+    else if (useBytes)
+	SET_STRING_ELT(ans, i, mkChar(cbuf));
+    else if (use_UTF8)
+	SET_STRING_ELT(ans, i, mkCharCE(cbuf, CE_UTF8));
+    else
+	SET_STRING_ELT(ans, i, markKnown(cbuf, STRING_ELT(text, i)));
+    free(cbuf);
+}
+
+/* Does repl use \U or \L?  (R_pcre_string_adj() then uses the R API
+   with use_UTF8.) */
+static Rboolean changes_case(const char *repl)
+{
+    for (const char *p = repl; *p; p++)
+	if (*p == '\\') {
+	    if (p[1] == 'U' || p[1] == 'L') return TRUE;
+	    if (p[1]) p++;
+	}
+    return FALSE;
+}
+
+static void sub_match(rx_par *p, int t, int from, int to)
+{
+    for (int k = from; k < to; k++) {
+	const char *s = p->s[k];
+	if (!s) continue;
+	if (!rx_par_valid(p, s)) p->code[k] = RX_INVALID;
+	else
+	    p->out[k] = R_pcre2_sub(p->re, s, p->repl, p->replen, p->global,
+				    p->use_UTF8, p->mdata[t],
+				    p->mcontext[t], p->code + k);
+    }
+}
+
+/* sub() and gsub() in parallel, setting the elements of ans */
+static void sub_par(rx_par *p, SEXP text, SEXP rep, SEXP ans)
+{
+    RCNTXT cntxt;
+    const void *vmax = vmaxget();
+
+    rx_par_begin(&cntxt, p);
+    while (rx_par_next(p, text)) {
+	rx_par_run(p, sub_match);
+	for (int k = 0; k < p->nb; k++) {
+	    R_xlen_t i = p->base + k;
+	    if (!p->s[k])
+		SET_STRING_ELT(ans, i, NA_STRING);
+	    else if (p->code[k] == RX_INVALID) {
+		if (p->use_UTF8)
+		    error(("input string %d is invalid UTF-8"), (int) i+1);
+		else
+		    error(("input string %d is invalid in this locale"),
+			  (int) i+1);
+	    } else {
+		R_pcre2_sub_set(ans, i, text, rep, p->out[k], p->code[k],
+				p->useBytes, p->use_UTF8);
+		p->out[k] = NULL;
+	    }
+	}
+	vmaxset(vmax);
+	R_CheckUserInterrupt();
+    }
+    endcontext(&cntxt);
+    rx_par_free(p);
+}
+#endif
+
 static wchar_t *wstring_adj(wchar_t *target, const wchar_t *orig,
 			    const wchar_t *repl, regmatch_t *regmatch)
 {
@@ -1877,22 +2512,26 @@ SEXP attribute_hidden do_gsub(SEXP call, SEXP op, SEXP args, SEXP env)
 {
     SEXP pat, rep, text, ans;
     regex_t reg;
+    rx_entry *rxe = NULL;
+    RCNTXT rxcntxt;
     regmatch_t regmatch[10];
     R_xlen_t i, n;
     int j, ns, nns, nmatch, offset, rc;
     int global, igcase_opt, perl_opt, fixed_opt, useBytes, eflags, last_end;
+    int threads;
     char *u, *cbuf;
     const char *spat = NULL, *srep = NULL, *s = NULL;
     size_t patlen = 0, replen = 0;
     Rboolean use_UTF8 = FALSE, use_WC = FALSE;
     const wchar_t *wrep = NULL;
-    const unsigned char *tables = NULL;
 #ifdef HAVE_PCRE2
     uint32_t ovecsize = 10;
     pcre2_code *re = NULL;
     pcre2_match_context *mcontext = NULL;
     pcre2_match_data *mdata = NULL;
+    rx_par par;
 #else
+    const unsigned char *tables = NULL;
     int ovecsize = 30;
     pcre *re_pcre = NULL;
     pcre_extra *re_pe  = NULL;
@@ -1910,10 +2549,13 @@ SEXP attribute_hidden do_gsub(SEXP call, SEXP op, SEXP args, SEXP env)
     perl_opt = asLogical(CAR(args)); args = CDR(args);
     fixed_opt = asLogical(CAR(args)); args = CDR(args);
     useBytes = asLogical(CAR(args)); args = CDR(args);
+    threads = asInteger(CAR(args));
     if (igcase_opt == NA_INTEGER) igcase_opt = 0;
     if (perl_opt == NA_INTEGER) perl_opt = 0;
     if (fixed_opt == NA_INTEGER) fixed_opt = 0;
     if (useBytes == NA_INTEGER) useBytes = 0;
+    if (threads == NA_INTEGER || threads < 1)
+	error(_("invalid '%s' argument"), "threads");
     if (fixed_opt && igcase_opt)
 	warning(_("argument '%s' will be ignored"), "ignore.case = TRUE");
     if (fixed_opt && perl_opt) {
@@ -2011,8 +2653,9 @@ SEXP attribute_hidden do_gsub(SEXP call, SEXP op, SEXP args, SEXP env)
 	replen = strlen(srep);
     } else if (perl_opt) {
 #ifdef HAVE_PCRE2
-	R_pcre2_prepare(spat, text, use_UTF8, igcase_opt, &tables, &re,
-	                &mcontext);
+	rxe = R_pcre2_prepare(spat, text, use_UTF8, igcase_opt, &re,
+			      &mcontext);
+	rx_hold(rxe, &rxcntxt);
 	mdata = pcre2_match_data_create(ovecsize, NULL);
 #else
 	R_pcre_prepare(spat, text, use_UTF8, igcase_opt, FALSE, &tables,
@@ -2023,19 +2666,32 @@ SEXP attribute_hidden do_gsub(SEXP call, SEXP op, SEXP args, SEXP env)
 	int cflags = REG_EXTENDED;
 	if (igcase_opt) cflags |= REG_ICASE;
 	if (!use_WC) {
-	    rc =  tre_regcompb(&reg, spat, cflags);
+	    rc = R_tre_prepare(&reg, &rxe, RX_TREB, spat, cflags);
 	    if (rc) reg_report(rc, &reg, spat);
 	    replen = strlen(srep);
 	} else {
-	    rc  = tre_regwcomp(&reg, wtransChar(STRING_ELT(pat, 0)), cflags);
+	    rc = R_tre_prepare(&reg, &rxe, RX_TREW,
+			       wtransChar(STRING_ELT(pat, 0)), cflags);
 	    if (rc) reg_report(rc, &reg, CHAR(STRING_ELT(pat, 0)));
 	    wrep = wtransChar(STRING_ELT(rep, 0));
 	    replen = wcslen(wrep);
 	}
+	rx_hold(rxe, &rxcntxt);
     }
 
     PROTECT(ans = allocVector(STRSXP, n));
     vmax = vmaxget();
+#ifdef HAVE_PCRE2
+    if (perl_opt && !(use_UTF8 && changes_case(srep)) &&
+	rx_par_init(&par, threads, n, rxe, mcontext, ovecsize, TRUE)) {
+	par.useBytes = useBytes;
+	par.use_UTF8 = use_UTF8;
+	par.repl = srep;
+	par.replen = replen;
+	par.global = global;
+	sub_par(&par, text, rep, ans);
+    } else
+#endif
     for (i = 0 ; i < n ; i++) {
 //	if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
 	/* NA pattern was handled above */
@@ -2096,18 +2752,19 @@ SEXP attribute_hidden do_gsub(SEXP call, SEXP op, SEXP args, SEXP env)
 		Free(cbuf);
 	    }
 	} else if (perl_opt) {
-	   int ncap, maxrep;
 #ifdef HAVE_PCRE2
-	   uint32_t eflag;
-	   PCRE2_SIZE *ovector = NULL;
+	    int st;
+	    cbuf = R_pcre2_sub(re, s, srep, replen, global, use_UTF8,
+			       mdata, mcontext, &st);
+	    R_pcre2_sub_set(ans, i, text, rep, cbuf, st, useBytes, use_UTF8);
 #else
+	   int ncap, maxrep;
 	   int eflag;
 	   int ovector[ovecsize];
 	   /* zero for unknown patterns; this is done to make sure that back
               references to unset groups return an empty string, but it is
 	      not needed anymore as ncap is being checked due to PCRE2 */
 	   memset(ovector, 0, ovecsize*sizeof(int));
-#endif
 	   ns = (int) strlen(s);
 	   /* worst possible scenario is to put a copy of the
 	      replacement after every character, unless there are
@@ -2122,17 +2779,8 @@ SEXP attribute_hidden do_gsub(SEXP call, SEXP op, SEXP args, SEXP env)
 	   u = cbuf = Calloc(nns, char);
 	   offset = 0; nmatch = 0; eflag = 0; last_end = -1;
 	   /* ncap is one more than the number of capturing patterns */
-#ifdef HAVE_PCRE2
-	   /* PCRE2 has also pcre2_substitute */
-	   while ((ncap = pcre2_match(re, (PCRE2_SPTR) s, (PCRE2_SIZE) ns,
-	                              (PCRE2_SIZE) offset, eflag, mdata,
-	                              mcontext)) >= 0 ) {
-
-	       ovector = pcre2_get_ovector_pointer(mdata);
-#else
 	   while ((ncap = pcre_exec(re_pcre, re_pe, s, ns, offset, eflag,
 				   ovector, 30)) >= 0) {
-#endif
 	       /* printf("%s, %d, %d %d\n", s, offset,
 		  ovector[0], ovector[1]); */
 	       nmatch++;
@@ -2166,11 +2814,7 @@ SEXP attribute_hidden do_gsub(SEXP call, SEXP op, SEXP args, SEXP env)
 		   u = tmp + (u - cbuf);
 		   cbuf = tmp;
 	       }
-#ifdef HAVE_PCRE2
-	       eflag = PCRE2_NOTBOL;  /* probably not needed */
-#else
 	       eflag = PCRE_NOTBOL;  /* probably not needed */
-#endif
 	   }
 	   R_pcre_exec_error(ncap, i);
 	   if (nmatch == 0)
@@ -2197,6 +2841,7 @@ SEXP attribute_hidden do_gsub(SEXP call, SEXP op, SEXP args, SEXP env)
 		   SET_STRING_ELT(ans, i, markKnown(cbuf, STRING_ELT(text, i)));
 	   }
 	   Free(cbuf);
+#endif
        } else if (!use_WC) {
 	    int maxrep, rc;
 	    /* extended regexp in bytes */
@@ -2333,30 +2978,34 @@ SEXP attribute_hidden do_gsub(SEXP call, SEXP op, SEXP args, SEXP env)
     else if (perl_opt) {
 #ifdef HAVE_PCRE2
 	pcre2_match_data_free(mdata);
-	pcre2_code_free(re);
 	pcre2_match_context_free(mcontext);
-	if (tables)
-	    /* new PCRE2 will have pcre2_maketables_free() */
-	    free((void *)tables);
+	rx_release(rxe, &rxcntxt);
 #else
 	if (re_pe) pcre_free_study(re_pe);
 	pcre_free(re_pcre);
 	pcre_free((void *)tables);
 #endif
-    } else tre_regfree(&reg);
+    } else rx_release(rxe, &rxcntxt);
     SHALLOW_DUPLICATE_ATTRIB(ans, text);
     /* This copied the class, if any */
     UNPROTECT(1);
     return ans;
 }
 
+/* The number of wchar_t in the first st bytes of s, or -1 if these are
+   not valid UTF-8.  Uses no R API, so can be called by worker threads. */
 static int getNc(const char *s, int st)
 {
-    R_CheckStack2(st+1);
-    char *buf = alloca(st+1);
-    memcpy(buf, s, st);
-    buf[st] = '\0';
-    return (int) utf8towcs(NULL, buf, 0);
+    int i, nc, used;
+    wchar_t wc;
+
+    for (i = 0, nc = 0; i < st; i += used, nc++) {
+	used = (int) utf8toucs(&wc, s + i);
+	if (used <= 0 || i + used > st) return -1;
+	/* a surrogate pair with 16-bit wchar_t, as from utf8towcs() */
+	if (used == 4 && sizeof(wchar_t) < 4) nc++;
+    }
+    return nc;
 }
 
 
@@ -2773,23 +3422,87 @@ static SEXP gregexpr_BadStringAns(void)
     return ans;
 }
 
+#ifdef HAVE_PCRE2
+static void regexpr_match(rx_par *p, int t, int from, int to)
+{
+    for (int k = from; k < to; k++) {
+	R_xlen_t i = p->base + k;
+	const char *s = p->s[k];
+	int rc = 0;
+	if (!s)
+	    p->start[i] = p->len[i] = NA_INTEGER;
+	else if (!rx_par_valid(p, s)) {
+	    rc = RX_INVALID;
+	    p->start[i] = p->len[i] = -1;
+	} else {
+	    rc = pcre2_match(p->re, (PCRE2_SPTR) s, PCRE2_ZERO_TERMINATED,
+			     0, 0, p->mdata[t], p->mcontext[t]);
+	    if (rc >= 0)
+		extract_match_and_groups(p->use_UTF8,
+					 pcre2_get_ovector_pointer(p->mdata[t]),
+					 p->ncap, p->start + i, p->len + i,
+					 p->cstart + i, p->clen + i,
+					 s, (int) p->n);
+	    else {
+		p->start[i] = p->len[i] = -1;
+		for(int cn = 0; cn < p->ncap; cn++)
+		    p->cstart[i + cn*p->n] = p->clen[i + cn*p->n] = -1;
+	    }
+	}
+	p->code[k] = rc;
+    }
+}
+
+/* regexpr() in parallel, with the vectors of the result set up */
+static void regexpr_par(rx_par *p, SEXP text)
+{
+    RCNTXT cntxt;
+    const void *vmax = vmaxget();
+    int nwarn = 0;
+
+    rx_par_begin(&cntxt, p);
+    while (rx_par_next(p, text)) {
+	rx_par_run(p, regexpr_match);
+	for (int k = 0; k < p->nb; k++) {
+	    R_xlen_t i = p->base + k;
+	    if (!p->s[k]) continue;
+	    if (p->code[k] == RX_INVALID) {
+		if(nwarn++ < NWARN) {
+		    if (p->use_UTF8)
+			warning(_("input string %d is invalid UTF-8"), (int) (i+1));
+		    else
+			warning(_("input string %d is invalid in this locale"), (int) (i+1));
+		}
+	    } else R_pcre_exec_error(p->code[k], i);
+	}
+	vmaxset(vmax);
+	R_CheckUserInterrupt();
+    }
+    endcontext(&cntxt);
+    rx_par_free(p);
+}
+#endif
+
 SEXP attribute_hidden do_regexpr(SEXP call, SEXP op, SEXP args, SEXP env)
 {
     SEXP pat, text, ans, itype;
     regex_t reg;
+    rx_entry *rxe = NULL;
+    RCNTXT rxcntxt;
     regmatch_t regmatch[10];
     R_xlen_t i, n;
-    int rc, igcase_opt, perl_opt, fixed_opt, useBytes;
+    int rc, igcase_opt, perl_opt, fixed_opt, useBytes, threads = 1;
     const char *spat = NULL; /* -Wall */
     const char *s = NULL;
-    const unsigned char *tables = NULL /* -Wall */;
 #ifdef HAVE_PCRE2
     pcre2_code *re = NULL;
     pcre2_match_context *mcontext = NULL;
     pcre2_match_data *mdata = NULL;
     PCRE2_SIZE *ovector = NULL;
     uint32_t name_count, name_entry_size, capture_count;
+    rx_par par;
 #else
+    const unsigned char *tables = NULL /* -Wall */;
     pcre *re_pcre = NULL /* -Wall */;
     pcre_extra *re_pe = NULL;
     int *ovector = NULL, name_count, name_entry_size, capture_count;
@@ -2808,10 +3521,14 @@ SEXP attribute_hidden do_regexpr(SEXP call, SEXP op, SEXP args, SEXP env)
     perl_opt = asLogical(CAR(args)); args = CDR(args);
     fixed_opt = asLogical(CAR(args)); args = CDR(args);
     useBytes = asLogical(CAR(args)); args = CDR(args);
+    if (PRIMVAL(op) == 0) /* regexpr */
+	threads = asInteger(CAR(args));
     if (igcase_opt == NA_INTEGER) igcase_opt = 0;
     if (perl_opt == NA_INTEGER) perl_opt = 0;
     if (fixed_opt == NA_INTEGER) fixed_opt = 0;
     if (useBytes == NA_INTEGER) useBytes = 0;
+    if (threads == NA_INTEGER || threads < 1)
+	error(_("invalid '%s' argument"), "threads");
     if (fixed_opt && igcase_opt)
 	warning(_("argument '%s' will be ignored"), "ignore.case = TRUE");
     if (fixed_opt && perl_opt) {
@@ -2889,8 +3606,9 @@ SEXP attribute_hidden do_regexpr(SEXP call, SEXP op, SEXP args, SEXP env)
     if (fixed_opt) ;
     else if (perl_opt) {
 #ifdef HAVE_PCRE2
-	R_pcre2_prepare(spat, text, use_UTF8, igcase_opt, &tables, &re,
-	                &mcontext);
+	rxe = R_pcre2_prepare(spat, text, use_UTF8, igcase_opt, &re,
+			      &mcontext);
+	rx_hold(rxe, &rxcntxt);
 
 	/* also extract info for named groups */
 	pcre2_pattern_info(re, PCRE2_INFO_NAMECOUNT, &name_count);
@@ -2934,10 +3652,12 @@ SEXP attribute_hidden do_regexpr(SEXP call, SEXP op, SEXP args, SEXP env)
 	int cflags = REG_EXTENDED;
 	if (igcase_opt) cflags |= REG_ICASE;
 	if (!use_WC)
-	    rc = tre_regcompb(&reg, spat, cflags);
+	    rc = R_tre_prepare(&reg, &rxe, RX_TREB, spat, cflags);
 	else
-	    rc = tre_regwcomp(&reg, wtransChar(STRING_ELT(pat, 0)), cflags);
+	    rc = R_tre_prepare(&reg, &rxe, RX_TREW,
+			       wtransChar(STRING_ELT(pat, 0)), cflags);
 	if (rc) reg_report(rc, &reg, spat);
+	rx_hold(rxe, &rxcntxt);
     }
 
     if (PRIMVAL(op) == 0) { /* regexpr */
@@ -2973,6 +3693,19 @@ SEXP attribute_hidden do_regexpr(SEXP call, SEXP op, SEXP args, SEXP env)
 		is[i] = il[i] = NA_INTEGER;
 	} else is = il = INTEGER(ans); // not actually used, but is + i has to be legal
 	vmax = vmaxget();
+#ifdef HAVE_PCRE2
+	if (perl_opt && rx_par_init(&par, threads, n, rxe, mcontext,
+				    ovector_size, FALSE)) {
+	    par.useBytes = useBytes;
+	    par.use_UTF8 = use_UTF8;
+	    par.start = INTEGER(ans);
+	    par.len = INTEGER(matchlen);
+	    par.cstart = is;
+	    par.clen = il;
+	    par.ncap = (int) capture_count;
+	    regexpr_par(&par, text);
+	} else
+#endif
 	for (i = 0 ; i < n ; i++) {
 //	    if ((i+1) % NINTERRUPT == 0) R_CheckUserInterrupt();
 	    if (STRING_ELT(text, i) == NA_STRING) {
@@ -3107,11 +3840,8 @@ SEXP attribute_hidden do_regexpr(SEXP call, SEXP op, SEXP args, SEXP env)
     else if (perl_opt) {
 #ifdef HAVE_PCRE2
 	pcre2_match_data_free(mdata);
-	pcre2_code_free(re);
 	pcre2_match_context_free(mcontext);
-	if (tables)
-	    /* new PCRE2 will have pcre2_maketables_free() */
-	    free((void *)tables);
+	rx_release(rxe, &rxcntxt);
 #else
 	if (re_pe) pcre_free_study(re_pe);
 	pcre_free(re_pcre);
@@ -3120,7 +3850,7 @@ SEXP attribute_hidden do_regexpr(SEXP call, SEXP op, SEXP args, SEXP env)
 #endif
 	UNPROTECT(1);
     } else
-	tre_regfree(&reg);
+	rx_release(rxe, &rxcntxt);
 
     UNPROTECT(2);
     return ans;
@@ -3137,6 +3867,8 @@ SEXP attribute_hidden do_regexec(SEXP call, SEXP op, SEXP args, SEXP env)
     const void *vmax = NULL;
 
     regex_t reg;
+    rx_entry *rxe;
+    RCNTXT rxcntxt;
     size_t nmatch;
     regmatch_t *pmatch;
     R_xlen_t i, n;
@@ -3216,20 +3948,23 @@ SEXP attribute_hidden do_regexec(SEXP call, SEXP op, SEXP args, SEXP env)
     }
 
     if(useBytes)
-	rc = tre_regcompb(&reg, CHAR(STRING_ELT(pat, 0)), cflags);
+	rc = R_tre_prepare(&reg, &rxe, RX_TREB, CHAR(STRING_ELT(pat, 0)),
+			   cflags);
     else if (use_WC)
-	rc = tre_regwcomp(&reg, wtransChar(STRING_ELT(pat, 0)), cflags);
+	rc = R_tre_prepare(&reg, &rxe, RX_TREW,
+			   wtransChar(STRING_ELT(pat, 0)), cflags);
     else {
 	s = translateChar(STRING_ELT(pat, 0));
 	if(mbcslocale && !mbcsValid(s))
 	    error(_("regular expression is invalid in this locale"));
-	rc = tre_regcomp(&reg, s, cflags);
+	rc = R_tre_prepare(&reg, &rxe, RX_TRE, s, cflags);
     }
     if(rc) {
 	char errbuf[1001];
 	tre_regerror(rc, &reg, errbuf, 1001);
 	error(_("regcomp error: '%s'"), errbuf);
     }
+    rx_hold(rxe, &rxcntxt);
 
     nmatch = reg.re_nsub + 1;
 
@@ -3303,13 +4038,454 @@ SEXP attribute_hidden do_regexec(SEXP call, SEXP op, SEXP args, SEXP env)
 
     free(pmatch);
 
-    tre_regfree(&reg);
+    rx_release(rxe, &rxcntxt);
 
     UNPROTECT(2);
 
     return ans;
 }
 
+/* Aho-Corasick automaton for matchFixed(): the patterns (as bytes)
+   form a trie whose states are numbered in insertion order, state 0
+   being the root.  fail[s] is the state for the longest proper suffix
+   of s which is also in the trie, and outlen[s]/outpat[s] give the
+   longest pattern which is a suffix of s (0/-1 if none).  After
+   ac_build() the children of state s are the edges estart[s] to
+   estart[s+1]-1, sorted by label, and the root has a full table. */
+typedef struct {
+    int nstates, maxlen, empty;
+    int *child, *sibling, *fail, *outlen, *outpat, *estart, *etarget;
+    unsigned char *label, *elabel;
+    int root[256];
+} ac_automaton;
+
+static void ac_init(ac_automaton *ac, size_t nstates)
+{
+    if (nstates > INT_MAX)
+	error(_("too many characters in '%s'"), "patterns");
+    ac->nstates = 1;
+    ac->maxlen = 0;
+    ac->empty = -1;
+    ac->child = (int *) R_alloc(nstates, sizeof(int));
+    ac->sibling = (int *) R_alloc(nstates, sizeof(int));
+    ac->fail = (int *) R_alloc(nstates, sizeof(int));
+    ac->outlen = (int *) R_alloc(nstates, sizeof(int));
+    ac->outpat = (int *) R_alloc(nstates, sizeof(int));
+    ac->estart = (int *) R_alloc(nstates + 1, sizeof(int));
+    ac->etarget = (int *) R_alloc(nstates, sizeof(int));
+    ac->label = (unsigned char *) R_alloc(nstates, sizeof(char));
+    ac->elabel = (unsigned char *) R_alloc(nstates, sizeof(char));
+    ac->child[0] = -1;
+    ac->outlen[0] = 0;
+    ac->outpat[0] = -1;
+    for (int c = 0; c < 256; c++) ac->root[c] = -1;
+}
+
+/* Add pattern k: a duplicated pattern keeps the first index */
+static void ac_add(ac_automaton *ac, const unsigned char *p, int k)
+{
+    int s = 0, len = (int) strlen((const char *) p);
+
+    if (len == 0) {
+	if (ac->empty < 0) ac->empty = k;
+	return;
+    }
+    for (int j = 0; j < len; j++) {
+	int t = (s == 0) ? ac->root[p[j]] : ac->child[s];
+	if (s) while (t >= 0 && ac->label[t] != p[j]) t = ac->sibling[t];
+	if (t < 0) {
+	    t = ac->nstates++;
+	    ac->label[t] = p[j];
+	    ac->child[t] = -1;
+	    ac->outlen[t] = 0;
+	    ac->outpat[t] = -1;
+	    if (s == 0) {
+		ac->sibling[t] = -1;
+		ac->root[p[j]] = t;
+	    } else {
+		ac->sibling[t] = ac->child[s];
+		ac->child[s] = t;
+	    }
+	}
+	s = t;
+    }
+    if (ac->outpat[s] < 0) {
+	ac->outlen[s] = len;
+	ac->outpat[s] = k;
+    }
+    if (len > ac->maxlen) ac->maxlen = len;
+}
+
+static R_INLINE int ac_goto(const ac_automaton *ac, int s, unsigned char c)
+{
+    int lo = ac->estart[s], hi = ac->estart[s + 1];
+
+    if (hi - lo <= 8) {
+	for (; lo < hi; lo++)
+	    if (ac->elabel[lo] == c) return ac->etarget[lo];
+	return -1;
+    }
+    while (lo < hi) {
+	int mid = lo + (hi - lo) / 2;
+	if (ac->elabel[mid] < c) lo = mid + 1; else hi = mid;
+    }
+    return (lo < ac->estart[s + 1] && ac->elabel[lo] == c) ?
+	ac->etarget[lo] : -1;
+}
+
+static void ac_build(ac_automaton *ac)
+{
+    int n = ac->nstates, e = 0, head = 0, tail = 0;
+    /* child is no longer needed once the edges are laid out */
+    int *queue = ac->child;
+
+    /* lay out the edges of each state (in order of state number),
+       sorted by label by insertion sort as most states have few */
+    int *first = (int *) R_alloc(n, sizeof(int));
+    for (int s = 0; s < n; s++) first[s] = ac->child[s];
+    ac->estart[0] = 0;
+    for (int s = 0; s < n; s++) {
+	ac->estart[s] = e;
+	if (s == 0) continue;
+	for (int t = first[s]; t >= 0; t = ac->sibling[t]) {
+	    int j = e++;
+	    while (j > ac->estart[s] && ac->elabel[j - 1] > ac->label[t]) {
+		ac->elabel[j] = ac->elabel[j - 1];
+		ac->etarget[j] = ac->etarget[j - 1];
+		j--;
+	    }
+	    ac->elabel[j] = ac->label[t];
+	    ac->etarget[j] = t;
+	}
+    }
+    ac->estart[n] = e;
+
+    /* failure links in breadth-first order */
+    ac->fail[0] = 0;
+    for (int c = 0; c < 256; c++)
+	if (ac->root[c] >= 0) {
+	    ac->fail[ac->root[c]] = 0;
+	    queue[tail++] = ac->root[c];
+	}
+    while (head < tail) {
+	int s = queue[head++];
+	if (ac->outpat[s] < 0) {
+	    ac->outlen[s] = ac->outlen[ac->fail[s]];
+	    ac->outpat[s] = ac->outpat[ac->fail[s]];
+	}
+	for (int j = ac->estart[s]; j < ac->estart[s + 1]; j++) {
+	    int t = ac->etarget[j], f = ac->fail[s], g;
+	    unsigned char c = ac->elabel[j];
+	    while (f && (g = ac_goto(ac, f, c)) < 0) f = ac->fail[f];
+	    if (f == 0) g = ac->root[c];
+	    ac->fail[t] = (g >= 0 && g != t) ? g : 0;
+	    queue[tail++] = t;
+	}
+    }
+}
+
+/* Find the leftmost match in s, and of those starting there the
+   longest.  As no match ending at byte e can start before
+   e - maxlen + 1, the scan stops once that is past the best start. */
+static int ac_match(const ac_automaton *ac, const unsigned char *s,
+		    int *start, int *len)
+{
+    int st = 0, bs = -1, bl = 0, bp = -1;
+
+    if (ac->empty >= 0) {
+	bs = 0;
+	bp = ac->empty;
+    }
+    for (size_t e = 0; s[e]; e++) {
+	if (bs >= 0 && (ptrdiff_t) e - ac->maxlen + 1 > bs) break;
+	unsigned char c = s[e];
+	int t = -1;
+	while (st && (t = ac_goto(ac, st, c)) < 0) st = ac->fail[st];
+	st = st ? t : ac->root[c];
+	if (st < 0) st = 0;
+	int ol = ac->outlen[st];
+	if (ol > 0) {
+	    int b = (int) e - ol + 1;
+	    if (bs < 0 || b < bs || (b == bs && ol > bl)) {
+		bs = b;
+		bl = ol;
+		bp = ac->outpat[st];
+	    }
+	}
+    }
+    *start = bs;
+    *len = bl;
+    return bp;
+}
+
+/* matchFixed(patterns, x, useBytes) */
+SEXP attribute_hidden do_matchfixed(SEXP call, SEXP op, SEXP args, SEXP env)
+{
+    SEXP pat, text, ans, mstart, mlen;
+    int useBytes, use_UTF8 = FALSE, npat, nwarn = 0;
+    size_t nchar = 1;
+    R_xlen_t i, n;
+    ac_automaton ac;
+    const void *vmax = vmaxget();
+
+    checkArity(op, args);
+    pat = CAR(args); args = CDR(args);
+    text = CAR(args); args = CDR(args);
+    useBytes = asLogical(CAR(args));
+    if (!isString(pat))
+	error(_("invalid '%s' argument"), "patterns");
+    if (!isString(text))
+	error(_("invalid '%s' argument"), "x");
+    if (useBytes == NA_INTEGER) useBytes = 0;
+    npat = LENGTH(pat);
+    n = XLENGTH(text);
+
+    /* As for regexpr(fixed = TRUE), work in bytes if asked to, if any
+       input is marked as "bytes" or if all are ASCII, otherwise in
+       UTF-8 so that byte matches are also character matches. */
+    if (!useBytes) {
+	Rboolean onlyASCII = TRUE, haveBytes = FALSE;
+	for (int k = 0; k < npat; k++) {
+	    SEXP p = STRING_ELT(pat, k);
+	    if (IS_BYTES(p)) haveBytes = TRUE;
+	    if (!IS_ASCII(p)) onlyASCII = FALSE;
+	}
+	for (i = 0; i < n && !haveBytes; i++) {
+	    SEXP s = STRING_ELT(text, i);
+	    if (s == NA_STRING) continue;
+	    if (IS_BYTES(s)) haveBytes = TRUE;
+	    if (!IS_ASCII(s)) onlyASCII = FALSE;
+	}
+	useBytes = onlyASCII || haveBytes;
+	use_UTF8 = !useBytes;
+    }
+
+    for (int k = 0; k < npat; k++) {
+	if (STRING_ELT(pat, k) == NA_STRING)
+	    error(_("NA patterns are not allowed"));
+	nchar += LENGTH(STRING_ELT(pat, k));
+    }
+    /* translation to UTF-8 can lengthen a pattern, so count afterwards */
+    const char **p = (const char **) R_alloc(npat, sizeof(char *));
+    if (use_UTF8) {
+	nchar = 1;
+	for (int k = 0; k < npat; k++) {
+	    p[k] = translateCharUTF8(STRING_ELT(pat, k));
+	    if (!utf8Valid(p[k]))
+		error(_("pattern %d is invalid UTF-8"), k + 1);
+	    nchar += strlen(p[k]);
+	}
+    } else
+	for (int k = 0; k < npat; k++) p[k] = CHAR(STRING_ELT(pat, k));
+    ac_init(&ac, nchar);
+    for (int k = 0; k < npat; k++)
+	ac_add(&ac, (const unsigned char *) p[k], k);
+    ac_build(&ac);
+
+    PROTECT(ans = allocVector(INTSXP, n));
+    PROTECT(mstart = allocVector(INTSXP, n));
+    PROTECT(mlen = allocVector(INTSXP, n));
+    const void *vmax2 = vmaxget();
+    for (i = 0; i < n; i++) {
+	SEXP si = STRING_ELT(text, i);
+	int k = -1, st = -1, len = -1;
+	if (si == NA_STRING) {
+	    INTEGER(ans)[i] = INTEGER(mstart)[i] = INTEGER(mlen)[i] =
+		NA_INTEGER;
+	    continue;
+	}
+	const char *s = use_UTF8 ? translateCharUTF8(si) : CHAR(si);
+	if (use_UTF8 && !utf8Valid(s)) {
+	    if(nwarn++ < NWARN)
+		warning(_("input string %lld is invalid UTF-8"),
+			(long long) i + 1);
+	} else if ((k = ac_match(&ac, (const unsigned char *) s,
+				 &st, &len)) >= 0 && use_UTF8) {
+	    len = getNc(s + st, len);
+	    st = getNc(s, st);
+	}
+	INTEGER(ans)[i] = (k >= 0) ? k + 1 : NA_INTEGER;
+	INTEGER(mstart)[i] = (k >= 0) ? st + 1 : -1;
+	INTEGER(mlen)[i] = (k >= 0) ? len : -1;
+	vmaxset(vmax2);
+	if ((i + 1) % NINTERRUPT == 0) R_CheckUserInterrupt();
+    }
+    vmaxset(vmax);
+    setAttrib(ans, install("match.start"), mstart);
+    setAttrib(ans, install("match.length"), mlen);
+    setAttrib(ans, install("useBytes"), ScalarLogical(useBytes));
+    UNPROTECT(3);
+    return ans;
+}
+
+
+/* strfields(x, split, widths, n, fill, simplify, useBytes): split each
+   string into fields at a fixed separator or by character widths,
+   returning the fields column-wise: a list of n character vectors, or
+   a length(x) x n matrix.  This avoids the list of one vector per
+   string which strsplit() makes.
+
+   Non-ASCII strings are worked on in UTF-8 (unless useBytes is true),
+   so that widths count characters and a UTF-8 separator can only match
+   at a character boundary. */
+SEXP attribute_hidden do_strfields(SEXP call, SEXP op, SEXP args, SEXP env)
+{
+    SEXP x, split, widths, sfill, ans, fill;
+    int n, nw = 0, simplify, useBytes, nwarn = 0;
+    const char *csplit = NULL, *usplit = NULL;
+    size_t slen = 0, uslen = 0;
+    R_xlen_t i, len;
+
+    checkArity(op, args);
+    x = CAR(args); args = CDR(args);
+    split = CAR(args); args = CDR(args);
+    widths = CAR(args); args = CDR(args);
+    n = asInteger(CAR(args)); args = CDR(args);
+    sfill = CAR(args); args = CDR(args);
+    simplify = asLogical(CAR(args)); args = CDR(args);
+    useBytes = asLogical(CAR(args));
+    if (!isString(x))
+	error(_("non-character argument"));
+    if (simplify == NA_INTEGER) simplify = 0;
+    if (useBytes == NA_INTEGER) useBytes = 0;
+    if (!isString(sfill) || LENGTH(sfill) != 1)
+	error(_("invalid '%s' argument"), "fill");
+    fill = STRING_ELT(sfill, 0);
+    len = XLENGTH(x);
+
+    if (!useBytes)
+	for (i = 0; i < len; i++)
+	    if (IS_BYTES(STRING_ELT(x, i))) {
+		useBytes = TRUE;
+		break;
+	    }
+    if (!isNull(split)) {
+	if (!isString(split) || LENGTH(split) != 1 ||
+	    STRING_ELT(split, 0) == NA_STRING || !CHAR(STRING_ELT(split, 0))[0])
+	    error(_("invalid '%s' argument"), "split");
+	if (IS_BYTES(STRING_ELT(split, 0))) useBytes = TRUE;
+	csplit = CHAR(STRING_ELT(split, 0));
+	slen = strlen(csplit);
+	if (!useBytes) {
+	    usplit = translateCharUTF8(STRING_ELT(split, 0));
+	    if (!utf8Valid(usplit))
+		error(_("'split' string %d is invalid UTF-8"), 1);
+	    uslen = strlen(usplit);
+	}
+    } else {
+	if (!isInteger(widths) || (nw = LENGTH(widths)) == 0)
+	    error(_("invalid '%s' argument"), "widths");
+	for (int j = 0; j < nw; j++)
+	    if (INTEGER(widths)[j] == NA_INTEGER || INTEGER(widths)[j] < 1)
+		error(_("invalid '%s' argument"), "widths");
+	n = nw;
+    }
+
+    /* If not given, the number of fields is the largest in any string */
+    if (n == NA_INTEGER) {
+	const void *vmax = vmaxget();
+	n = 1;
+	for (i = 0; i < len; i++) {
+	    SEXP el = STRING_ELT(x, i);
+	    if (el == NA_STRING) continue;
+	    Rboolean bytes = useBytes || IS_ASCII(el);
+	    const char *s = bytes ? CHAR(el) : translateCharUTF8(el),
+		*sep = bytes ? csplit : usplit, *end = s + strlen(s);
+	    size_t seplen = bytes ? slen : uslen;
+	    int nf = 1;
+	    for (const char *p = s; (p = fsearch(sep, seplen, p, end - p));
+		 p += seplen)
+		if (nf++ == INT_MAX)
+		    error(_("too many fields"));
+	    if (nf > n) n = nf;
+	    vmaxset(vmax);
+	}
+    } else if (n < 1)
+	error(_("invalid '%s' argument"), "n");
+
+    if (simplify) {
+	if (len > INT_MAX)
+	    error(_("too many rows for a matrix: use 'simplify = FALSE'"));
+	if ((double) len * n > R_XLEN_T_MAX)
+	    error(_("result would be too long a vector"));
+	PROTECT(ans = allocMatrix(STRSXP, (int) len, n));
+    } else {
+	PROTECT(ans = allocVector(VECSXP, n));
+	for (int j = 0; j < n; j++)
+	    SET_VECTOR_ELT(ans, j, allocVector(STRSXP, len));
+    }
+#define SET_FIELD(j, v)							\
+    do {								\
+	if (simplify) SET_STRING_ELT(ans, (j) * len + i, v);		\
+	else SET_STRING_ELT(VECTOR_ELT(ans, j), i, v);			\
+    } while (0)
+
+    const void *vmax = vmaxget();
+    for (i = 0; i < len; i++) {
+	SEXP el = STRING_ELT(x, i);
+	int j = 0;
+	cetype_t ienc = CE_NATIVE;
+	const char *s, *sep = csplit;
+	size_t seplen = slen;
+
+	if (el == NA_STRING) {
+	    for (; j < n; j++) SET_FIELD(j, NA_STRING);
+	    continue;
+	}
+	if (useBytes) {
+	    s = CHAR(el);
+	    ienc = getCharCE(el);
+	} else if (IS_ASCII(el))
+	    s = CHAR(el);
+	else {
+	    s = translateCharUTF8(el);
+	    if (!utf8Valid(s)) {
+		if(nwarn++ < NWARN)
+		    warning(_("input string %lld is invalid UTF-8"),
+			    (long long) i + 1);
+		for (; j < n; j++) SET_FIELD(j, NA_STRING);
+		vmaxset(vmax);
+		continue;
+	    }
+	    ienc = CE_UTF8;
+	    sep = usplit;
+	    seplen = uslen;
+	}
+	const char *p = s, *end = s + strlen(s);
+	if (csplit) {
+	    /* the last field takes the rest of the string */
+	    for (; j < n - 1; j++) {
+		const char *q = fsearch(sep, seplen, p, end - p);
+		if (q == NULL) break;
+		SET_FIELD(j, mkCharLenCE(p, (int) (q - p), ienc));
+		p = q + seplen;
+	    }
+	    SET_FIELD(j, mkCharLenCE(p, (int) (end - p), ienc));
+	    j++;
+	} else {
+	    /* widths are in chars, so in bytes for ASCII and useBytes */
+	    Rboolean utf8 = (ienc == CE_UTF8 && !useBytes);
+	    for (; j < n && p < end; j++) {
+		const char *q = p;
+		int w = INTEGER(widths)[j];
+		if (utf8)
+		    for (int k = 0; k < w && q < end; k++) q += utf8clen(*q);
+		else
+		    q = (end - p > w) ? p + w : end;
+		SET_FIELD(j, mkCharLenCE(p, (int) (q - p), ienc));
+		p = q;
+	    }
+	}
+	for (; j < n; j++) SET_FIELD(j, fill);
+	vmaxset(vmax);
+	if ((i + 1) % NINTERRUPT == 0) R_CheckUserInterrupt();
+    }
+#undef SET_FIELD
+    UNPROTECT(1);
+    return ans;
+}
+
+
 /* pcre_config was added in PCRE 4.0, with PCRE_CONFIG_UTF8 .
    PCRE_CONFIG_UNICODE_PROPERTIES had been added by 8.10,
    the earliest version we allow.
@@ -37,6 +37,12 @@
 
 #include "zlib.h"
 
+#if defined(HAVE_PTHREAD) && !defined(Win32)
+# define R_GZ_THREADS
+# include <pthread.h>
+# include <signal.h>
+#endif
+
 #ifdef Win32
 # define OS_CODE  0x06
 #else
@@ -55,6 +61,13 @@
 
 #define Z_BUFSIZE 16384
 
+/* R ADDITION: size of the blocks compressed independently when
+   writing with several threads (as used by pigz), and of the buffers
+   filled ahead when reading with several threads */
+#define Z_PBLOCK 131072
+
+struct gz_readahead;
+
 typedef struct gz_stream {
     z_stream stream;
     int      z_err;   /* error code for last stream operation */
@@ -67,6 +80,23 @@ typedef struct gz_stream {
     Rz_off_t  start;  /* start of compressed data in file (header skipped) */
     Rz_off_t  in;     /* bytes into deflate or inflate */
     Rz_off_t  out;    /* bytes out of deflate or inflate */
+    int      level, strategy; /* for deflate */
+    int      threads; /* > 1 when (de)compressing blocks in parallel */
+    Byte     *pbuf;   /* threads * Z_PBLOCK bytes of pending input */
+    size_t   pavail;  /* bytes in pbuf */
+    Byte     *pbuf2;  /* input being compressed in the background */
+    size_t   pavail2; /* bytes in pbuf2 */
+    Byte     *pout;   /* threads * poutsize bytes of compressed output */
+    uLong    poutsize;
+    uLong    *plen;   /* compressed length of each block in pout */
+    int      pbusy;   /* is pbuf2 being compressed? */
+    int      perr;    /* and the result */
+#ifdef R_GZ_THREADS
+    pthread_t pthread;
+#endif
+    int      framed;  /* does the current member have the 'RB' subfield? */
+    uLong    fsize;   /* if so, its size */
+    struct gz_readahead *ra; /* non-NULL when reading ahead */
 } gz_stream;
 
 
@@ -87,12 +117,17 @@ static int get_byte(gz_stream *s)
     return *(s->stream.next_in)++;
 }
 
+static void gz_rafree(gz_stream *s);
+static int gz_pwait(gz_stream *s);
+
 static int destroy (gz_stream *s)
 {
     int err = Z_OK;
 
     if (!s) return Z_STREAM_ERROR;
 
+    (void) gz_pwait(s);
+
     if (s->stream.state != NULL) {
         if (s->mode == 'w') err = deflateEnd(&(s->stream));
         else if (s->mode == 'r') err = inflateEnd(&(s->stream));
@@ -105,6 +140,11 @@ static int destroy (gz_stream *s)
     }
     if (s->z_err < 0) err = s->z_err;
 
+    gz_rafree(s);
+    free(s->pbuf);
+    free(s->pbuf2);
+    free(s->pout);
+    free(s->plen);
     if(s) free(s);
     return err;
 }
@@ -119,6 +159,27 @@ static int const gz_magic[2] = {0x1f, 0x8b}; /* gzip magic header */
 #define COMMENT      0x10 /* bit 4 set: file comment present */
 #define RESERVED     0xE0 /* bits 5..7: reserved */
 
+/* R ADDITION: the header of the members written when compressing in
+   parallel, to be followed by the size of the member (see gz_pcompress) */
+#define Z_FHDR 20
+static Byte const gz_fhdr[Z_FHDR - 4] = {0x1f, 0x8b, Z_DEFLATED, EXTRA_FIELD,
+					  0, 0, 0, 0, 0, OS_CODE,
+					  8, 0, 'R', 'B', 4, 0};
+
+static uLong z_getLE (const Byte *p)
+{
+    return (uLong) p[0] | ((uLong) p[1] << 8) | ((uLong) p[2] << 16) |
+	((uLong) p[3] << 24);
+}
+
+static void z_putLE (Byte *p, uLong x)
+{
+    for (int n = 0; n < 4; n++) {
+	p[n] = (Byte) (x & 0xff);
+	x >>= 8;
+    }
+}
+
 static void check_header(gz_stream *s)
 {
     int method; /* method byte */
@@ -126,6 +187,8 @@ static void check_header(gz_stream *s)
     uInt len;
     int c;
 
+    s->framed = 0;
+
     /* Assure two bytes in the buffer so we can peek ahead -- handle case
        where first byte of header is at the end of the buffer after the last
        gzip segment */
@@ -166,6 +229,15 @@ static void check_header(gz_stream *s)
     if ((flags & EXTRA_FIELD) != 0) { /* skip the extra field */
         len  =  (uInt )get_byte(s);
         len += ((uInt) get_byte(s)) << 8;
+        if (flags == EXTRA_FIELD && len == 8) {
+            /* R ADDITION: look for the 'RB' subfield of gz_fhdr */
+            Byte ex[8];
+            for (len = 0; len < 8; len++) ex[len] = (Byte) get_byte(s);
+            if (memcmp(ex, gz_fhdr + 12, 4) == 0) {
+                s->framed = 1;
+                s->fsize = z_getLE(ex + 4);
+            }
+        } else
         /* len is garbage if EOF but the loop below will quit anyway */
         while (len-- != 0 && get_byte(s) != EOF) ;
     }
@@ -210,6 +282,15 @@ gzFile R_gzopen (const char *path, const char *mode)
     s->crc = crc32(0L, Z_NULL, 0);
     s->transparent = 0;
     s->mode = '\0';
+    s->threads = 1;
+    s->pbuf = s->pbuf2 = s->pout = NULL;
+    s->plen = NULL;
+    s->pavail = s->pavail2 = 0;
+    s->pbusy = 0;
+    s->perr = Z_OK;
+    s->framed = 0;
+    s->fsize = 0;
+    s->ra = NULL;
     do {
         if (*p == 'r') s->mode = 'r';
         if (*p == 'w' || *p == 'a') s->mode = 'w';
@@ -220,6 +301,8 @@ gzFile R_gzopen (const char *path, const char *mode)
         else *m++ = *p; /* copy the mode */
     } while (*p++ && m != fmode + sizeof(fmode));
     if (s->mode == '\0') return destroy(s), (gzFile) Z_NULL;
+    s->level = level;
+    s->strategy = strategy;
 
     if (s->mode == 'w') {
         err = deflateInit2(&(s->stream), level,
@@ -277,19 +360,21 @@ static uLong getLong (gz_stream *s)
     return x;
 }
 
-static int R_gzread (gzFile file, voidp buf, unsigned len)
+/* R ADDITION: this does not call warning() (so can be run on another
+   thread), but counts in nwarn[0] the 'invalid or incomplete compressed
+   data' warnings and in nwarn[1] the 'error reading the file' ones for
+   the caller to signal. */
+static int gz_read (gz_stream *s, voidp buf, unsigned len, int *nwarn)
 {
-    gz_stream *s = (gz_stream*) file;
     Bytef *start = (Bytef*) buf; /* starting point for crc computation */
     Byte  *next_out; /* == stream.next_out but not forced far (for MSDOS) */
 
-    if (s == NULL || s->mode != 'r') return Z_STREAM_ERROR;
-
+    nwarn[0] = nwarn[1] = 0;
     if (s->z_err == Z_DATA_ERROR) {
-	warning("invalid or incomplete compressed data");
+	nwarn[0]++;
 	return -1;
     } else if(s->z_err == Z_ERRNO) {
-	warning("error reading the file");
+	nwarn[1]++;
 	return -1;
     }
     if (s->z_err == Z_STREAM_END) return 0;  /* EOF */
@@ -346,7 +431,7 @@ static int R_gzread (gzFile file, voidp buf, unsigned len)
             start = s->stream.next_out;
 
             if (getLong(s) != s->crc) {
-		warning("invalid or incomplete compressed data");
+		nwarn[0]++;
                 s->z_err = Z_DATA_ERROR;
             } else {
                 (void)getLong(s);
@@ -358,6 +443,10 @@ static int R_gzread (gzFile file, voidp buf, unsigned len)
                 if (s->z_err == Z_OK) {
                     inflateReset(&(s->stream));
                     s->crc = crc32(0L, Z_NULL, 0);
+                    /* R ADDITION: when reading ahead, leave members
+                       written in parallel to gz_readframes */
+                    if (s->ra && s->framed && s->stream.next_out != buf)
+                        break;
                 }
             }
         }
@@ -367,15 +456,372 @@ static int R_gzread (gzFile file, voidp buf, unsigned len)
 
     if (len == s->stream.avail_out &&
         (s->z_err == Z_DATA_ERROR || s->z_err == Z_ERRNO)) {
-	if(s->z_err == Z_DATA_ERROR)
-	    warning("invalid or incomplete compressed data");
-	else if(s->z_err == Z_ERRNO)
-	    warning("error reading the file");
+	if(s->z_err == Z_DATA_ERROR) nwarn[0]++;
+	else if(s->z_err == Z_ERRNO) nwarn[1]++;
 	return -1;
     }
     return (int)(len - s->stream.avail_out);
 }
 
+static void gz_warn (const int *nwarn)
+{
+    for (int i = 0; i < nwarn[0]; i++)
+	warning("invalid or incomplete compressed data");
+    for (int i = 0; i < nwarn[1]; i++)
+	warning("error reading the file");
+}
+
+
+/* R ADDITION: read-ahead.
+
+   When reading with threads > 1, a background thread inflates the
+   stream into a ring of buffers of Z_PBLOCK bytes ahead of the
+   consumer, so decompression (and disk reads) overlap with the
+   parsing of the data already read.  Members written in parallel (with
+   the 'RB' subfield giving their size) are read whole and inflated
+   several at a time, on up to 'threads' threads.  Only the thread
+   touches the gz_stream while it runs: the warnings it would have
+   given are kept with each buffer and signalled on the main thread
+   when the buffer is reached.  Seeking and telling stop the thread
+   (which the next read restarts), the buffered data being discarded by
+   a seek.  If the thread cannot be started the buffers are filled
+   synchronously.
+*/
+
+#define Z_RABUFS 4 /* the minimum number of buffers */
+
+#ifdef R_GZ_THREADS
+typedef struct gz_readahead {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;  /* signalled whenever a buffer is filled or freed */
+    int running, stop;
+    int done;             /* a buffer with EOF or an error has been filled */
+    int nbufs;
+    Byte **buf;           /* nbufs buffers of Z_PBLOCK bytes */
+    int *len;             /* as returned by gz_read */
+    int (*nwarn)[2];
+    Byte **cbuf;          /* a compressed member for each buffer */
+    uLong cbufsize, *csize;
+    int head, count;      /* first filled buffer, number filled */
+    int pos;              /* bytes of buf[head] already consumed */
+    int warned;           /* have the warnings of buf[head] been given? */
+} gz_readahead;
+
+/* read n bytes, starting with those in s->buffer */
+static uLong gz_input (gz_stream *s, Byte *buf, uLong n)
+{
+    uLong got = s->stream.avail_in;
+
+    if (got > n) got = n;
+    memcpy(buf, s->stream.next_in, got);
+    s->stream.next_in += got;
+    s->stream.avail_in -= (uInt) got;
+    if (got < n && !s->z_eof) {
+	errno = 0;
+	got += (uLong) fread(buf + got, 1, n - got, s->file);
+	if (got < n) {
+	    s->z_eof = 1;
+	    if (ferror(s->file)) s->z_err = Z_ERRNO;
+	}
+    }
+    return got;
+}
+
+/* At the start of a member with the 'RB' subfield (whose header has
+   been read), read up to n such members and inflate them in parallel
+   into the buffers from 'first' on, with the results gz_read would
+   have given.  Returns the number of buffers filled: 0 if the member
+   is to be read by gz_read. */
+static int gz_readframes (gz_stream *s, int first, int n)
+{
+    gz_readahead *ra = s->ra;
+    int k = 0;
+
+    if (!s->framed || s->transparent || s->z_err != Z_OK ||
+	s->stream.total_in != 0)
+	return 0;
+    while (k < n && s->framed) {
+	int slot = (first + k) % ra->nbufs;
+	uLong need = s->fsize - Z_FHDR;
+	Byte hdr[Z_FHDR];
+
+	if (s->fsize < Z_FHDR + 10 || need > ra->cbufsize) break;
+	if (gz_input(s, ra->cbuf[slot], need) != need) { /* truncated */
+	    if (s->z_err != Z_ERRNO) s->z_err = Z_DATA_ERROR;
+	    ra->len[slot] = -1;
+	    ra->nwarn[slot][0] = (s->z_err == Z_DATA_ERROR);
+	    ra->nwarn[slot][1] = (s->z_err == Z_ERRNO);
+	    ra->csize[slot] = 0;
+	    k++;
+	    break;
+	}
+	s->in += need;
+	/* an empty member would look like EOF to the consumer */
+	if (z_getLE(ra->cbuf[slot] + need - 4) != 0) {
+	    ra->csize[slot] = need;
+	    k++;
+	}
+
+	/* and the header of the next member */
+	uLong got = gz_input(s, hdr, Z_FHDR);
+	if (got == 0) {
+	    s->framed = 0;
+	    if (s->z_err == Z_OK) s->z_err = Z_STREAM_END;
+	} else if (got == Z_FHDR && memcmp(hdr, gz_fhdr, 4) == 0 &&
+		   memcmp(hdr + 10, gz_fhdr + 10, 6) == 0) {
+	    s->fsize = z_getLE(hdr + 16);
+	} else {
+	    /* put it back for check_header and gz_read */
+	    memmove(s->buffer + got, s->stream.next_in, s->stream.avail_in);
+	    memcpy(s->buffer, hdr, got);
+	    s->stream.next_in = s->buffer;
+	    s->stream.avail_in += (uInt) got;
+	    s->z_eof = 0;
+	    check_header(s);
+	    s->framed = 0;
+	}
+    }
+
+#ifdef _OPENMP
+# pragma omp parallel for num_threads(s->threads) schedule(static, 1)
+#endif
+    for (int i = 0; i < k; i++) {
+	int slot = (first + i) % ra->nbufs;
+	uLong csize = ra->csize[slot];
+	const Byte *trailer = ra->cbuf[slot] + csize - 8;
+	z_stream strm;
+	int ok = 0;
+
+	if (csize == 0) continue;
+	strm.zalloc = (alloc_func) 0;
+	strm.zfree = (free_func) 0;
+	strm.opaque = (voidpf) 0;
+	strm.next_in = ra->cbuf[slot];
+	strm.avail_in = (uInt) (csize - 8);
+	if (inflateInit2(&strm, -MAX_WBITS) == Z_OK) {
+	    strm.next_out = ra->buf[slot];
+	    strm.avail_out = Z_PBLOCK;
+	    ok = inflate(&strm, Z_FINISH) == Z_STREAM_END &&
+		strm.total_out == z_getLE(trailer + 4) &&
+		crc32(0L, ra->buf[slot], (uInt) strm.total_out)
+		== z_getLE(trailer);
+	    inflateEnd(&strm);
+	}
+	ra->len[slot] = ok ? (int) strm.total_out : -1;
+	ra->nwarn[slot][0] = !ok;
+	ra->nwarn[slot][1] = 0;
+    }
+    for (int i = 0; i < k; i++) {
+	int len = ra->len[(first + i) % ra->nbufs];
+	if (len < 0) {
+	    if (s->z_err == Z_OK || s->z_err == Z_STREAM_END)
+		s->z_err = Z_DATA_ERROR;
+	    return i + 1;
+	}
+	s->out += len;
+    }
+    return k;
+}
+
+static void *gz_rathread (void *arg)
+{
+    gz_stream *s = (gz_stream *) arg;
+    gz_readahead *ra = s->ra;
+
+    pthread_mutex_lock(&ra->lock);
+    while (!ra->stop && !ra->done) {
+	if (ra->count == ra->nbufs) {
+	    pthread_cond_wait(&ra->cond, &ra->lock);
+	    continue;
+	}
+	int slot = (ra->head + ra->count) % ra->nbufs, done = 0;
+	int n = ra->nbufs - ra->count;
+	if (n > s->threads) n = s->threads;
+	pthread_mutex_unlock(&ra->lock);
+	n = gz_readframes(s, slot, n);
+	if (n == 0) {
+	    ra->len[slot] = gz_read(s, ra->buf[slot], Z_PBLOCK, ra->nwarn[slot]);
+	    n = 1;
+	}
+	for (int i = 0; i < n; i++)
+	    if (ra->len[(slot + i) % ra->nbufs] <= 0) done = 1;
+	pthread_mutex_lock(&ra->lock);
+	ra->count += n;
+	if (done) ra->done = 1;
+	pthread_cond_broadcast(&ra->cond);
+    }
+    pthread_mutex_unlock(&ra->lock);
+    return NULL;
+}
+
+static void gz_rastart (gz_stream *s)
+{
+    gz_readahead *ra = s->ra;
+    sigset_t all, old;
+
+    /* signals are for the main thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    ra->running = (pthread_create(&ra->thread, NULL, gz_rathread, s) == 0);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+static void gz_rastop (gz_stream *s)
+{
+    gz_readahead *ra = s->ra;
+
+    if (!ra || !ra->running) return;
+    pthread_mutex_lock(&ra->lock);
+    ra->stop = 1;
+    pthread_cond_broadcast(&ra->cond);
+    pthread_mutex_unlock(&ra->lock);
+    pthread_join(ra->thread, NULL);
+    ra->running = ra->stop = 0;
+}
+
+/* number of bytes read from the stream but not yet consumed:
+   the thread must be stopped */
+static Rz_off_t gz_rabuffered (gz_stream *s)
+{
+    gz_readahead *ra = s->ra;
+    Rz_off_t n = -ra->pos;
+
+    for (int i = 0; i < ra->count; i++) {
+	int len = ra->len[(ra->head + i) % ra->nbufs];
+	if (len > 0) n += len;
+    }
+    return n;
+}
+
+static void gz_radiscard (gz_stream *s)
+{
+    gz_readahead *ra = s->ra;
+    ra->head = ra->count = ra->pos = ra->warned = ra->done = 0;
+}
+
+static int gz_raread (gz_stream *s, Byte *buf, unsigned len)
+{
+    gz_readahead *ra = s->ra;
+    unsigned got = 0;
+
+    if (!ra->running && !ra->done) gz_rastart(s);
+    while (got < len) {
+	int slot, n, count;
+	unsigned m;
+
+	pthread_mutex_lock(&ra->lock);
+	while (ra->count == 0 && ra->running && !ra->done)
+	    pthread_cond_wait(&ra->cond, &ra->lock);
+	count = ra->count;
+	pthread_mutex_unlock(&ra->lock);
+	slot = ra->head;
+	if (count == 0) { /* no thread: fill a buffer here */
+	    ra->len[slot] = gz_read(s, ra->buf[slot], Z_PBLOCK, ra->nwarn[slot]);
+	    if (ra->len[slot] <= 0) ra->done = 1;
+	    ra->count = 1;
+	}
+	if (!ra->warned) {
+	    ra->warned = 1;
+	    gz_warn(ra->nwarn[slot]);
+	}
+	n = ra->len[slot];
+	if (n <= 0) { /* EOF or error: this stays at the head */
+	    if (n < 0 && got == 0) return -1;
+	    break;
+	}
+	m = (unsigned) (n - ra->pos);
+	if (m > len - got) m = len - got;
+	memcpy(buf + got, ra->buf[slot] + ra->pos, m);
+	got += m;
+	ra->pos += (int) m;
+	if (ra->pos == n) {
+	    pthread_mutex_lock(&ra->lock);
+	    ra->head = (ra->head + 1) % ra->nbufs;
+	    ra->count--;
+	    ra->pos = ra->warned = 0;
+	    pthread_cond_broadcast(&ra->cond);
+	    pthread_mutex_unlock(&ra->lock);
+	}
+    }
+    return (int) got;
+}
+
+static int gz_rainit (gz_stream *s)
+{
+    gz_readahead *ra = (gz_readahead *) calloc(1, sizeof(gz_readahead));
+    int nbufs = 2 * s->threads;
+
+    if (!ra) return Z_MEM_ERROR;
+    if (nbufs < Z_RABUFS) nbufs = Z_RABUFS;
+    ra->nbufs = nbufs;
+    ra->cbufsize = compressBound(Z_PBLOCK) + 8;
+    ra->buf = (Byte **) calloc(2 * nbufs, sizeof(Byte *));
+    ra->len = (int *) malloc(nbufs * sizeof(int));
+    ra->nwarn = (int (*)[2]) malloc(nbufs * sizeof(int[2]));
+    ra->csize = (uLong *) malloc(nbufs * sizeof(uLong));
+    pthread_mutex_init(&ra->lock, NULL);
+    pthread_cond_init(&ra->cond, NULL);
+    s->ra = ra;
+    if (!ra->buf || !ra->len || !ra->nwarn || !ra->csize) {
+	gz_rafree(s);
+	return Z_MEM_ERROR;
+    }
+    ra->cbuf = ra->buf + nbufs;
+    ra->buf[0] = (Byte *) malloc((size_t) nbufs * Z_PBLOCK);
+    ra->cbuf[0] = (Byte *) malloc((size_t) nbufs * ra->cbufsize);
+    if (!ra->buf[0] || !ra->cbuf[0]) {
+	gz_rafree(s);
+	return Z_MEM_ERROR;
+    }
+    for (int i = 1; i < nbufs; i++) {
+	ra->buf[i] = ra->buf[0] + (size_t) i * Z_PBLOCK;
+	ra->cbuf[i] = ra->cbuf[0] + (size_t) i * ra->cbufsize;
+    }
+    return Z_OK;
+}
+
+static void gz_rafree (gz_stream *s)
+{
+    gz_readahead *ra = s->ra;
+
+    if (!ra) return;
+    gz_rastop(s);
+    pthread_mutex_destroy(&ra->lock);
+    pthread_cond_destroy(&ra->cond);
+    if (ra->buf) {
+	free(ra->buf[0]);
+	if (ra->cbuf) free(ra->cbuf[0]);
+    }
+    free(ra->buf);
+    free(ra->len);
+    free(ra->nwarn);
+    free(ra->csize);
+    free(ra);
+    s->ra = NULL;
+}
+#else
+static void gz_rastop (gz_stream *s) {}
+static Rz_off_t gz_rabuffered (gz_stream *s) { return 0; }
+static void gz_radiscard (gz_stream *s) {}
+static int gz_raread (gz_stream *s, Byte *buf, unsigned len) { return -1; }
+static int gz_rainit (gz_stream *s) { return Z_OK; }
+static void gz_rafree (gz_stream *s) {}
+#endif
+
+static int R_gzread (gzFile file, voidp buf, unsigned len)
+{
+    gz_stream *s = (gz_stream*) file;
+    int nwarn[2], res;
+
+    if (s == NULL || s->mode != 'r') return Z_STREAM_ERROR;
+    if (s->ra) return gz_raread(s, (Byte *) buf, len);
+
+    res = gz_read(s, buf, len, nwarn);
+    gz_warn(nwarn);
+    return res;
+}
+
 /* for devPS.c */
 char *R_gzgets(gzFile file, char *buf, int len)
 {
@@ -388,11 +834,201 @@ char *R_gzgets(gzFile file, char *buf, int len)
 }
 
 
+/* R ADDITION: parallel compression.
+
+   When writing with threads > 1, input is collected into blocks of
+   Z_PBLOCK bytes which are deflated independently, each into a gzip
+   member of its own, at a small cost in compression ratio as
+   back-references do not cross block boundaries.  So the file is an
+   ordinary multi-member gzip file (like those of bgzip), whose members
+   have in their header an extra subfield 'RB' giving their size: a
+   reader can find them without inflating and inflate them in parallel
+   (see gz_readframes).  The simple header written when opening starts
+   an empty first member.
+
+   Where threads are available, a set of blocks is compressed and
+   written by a background thread (itself using OpenMP) while the next
+   set is being filled, so compression overlaps with whatever produces
+   the data, e.g. serialize().
+*/
+
+/* Must be called after opening and before reading or writing */
+static int R_gzsetthreads (gzFile file, int threads)
+{
+    gz_stream *s = (gz_stream*) file;
+
+    if (s == NULL) return Z_STREAM_ERROR;
+    if (s->mode == 'r') {
+	if (s->out != 0) return Z_STREAM_ERROR;
+	if (threads <= 1) return Z_OK;
+	s->threads = threads;
+	return gz_rainit(s);
+    }
+    if (s->mode != 'w' || s->in != 0) return Z_STREAM_ERROR;
+    if (threads <= 1) return Z_OK;
+
+    z_stream strm;
+    strm.zalloc = (alloc_func) 0;
+    strm.zfree = (free_func) 0;
+    strm.opaque = (voidpf) 0;
+    if (deflateInit2(&strm, s->level, Z_DEFLATED, -MAX_WBITS, MAX_MEM_LEVEL,
+		     s->strategy) != Z_OK)
+	return Z_STREAM_ERROR;
+    s->poutsize = Z_FHDR + deflateBound(&strm, Z_PBLOCK) + 8;
+    deflateEnd(&strm);
+
+    s->pbuf = (Byte *) malloc((size_t) threads * Z_PBLOCK);
+    s->pout = (Byte *) malloc((size_t) threads * s->poutsize);
+    s->plen = (uLong *) malloc(threads * sizeof(uLong));
+    if (!s->pbuf || !s->pout || !s->plen) {
+	free(s->pbuf); free(s->pout); free(s->plen);
+	s->pbuf = s->pout = NULL;
+	s->plen = NULL;
+	return Z_MEM_ERROR;
+    }
+#ifdef R_GZ_THREADS
+    /* without it, blocks are compressed in the foreground */
+    s->pbuf2 = (Byte *) malloc((size_t) threads * Z_PBLOCK);
+#endif
+    s->threads = threads;
+    s->pavail = 0;
+
+    /* finish the first member: an empty final block and the trailer */
+    static Byte const empty[10] = {3, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    if (fwrite(empty, 1, 10, s->file) != 10) return s->z_err = Z_ERRNO;
+    s->out += 10;
+    return Z_OK;
+}
+
+/* Compress n bytes into members and write them.  This may run on
+   another thread, so does not change s->z_err. */
+static int gz_pcompress (gz_stream *s, const Byte *buf, size_t n)
+{
+    int nblocks = (int) ((n + Z_PBLOCK - 1) / Z_PBLOCK), err = Z_OK;
+    uLong *outlen = s->plen;
+
+#ifdef _OPENMP
+# pragma omp parallel for num_threads(s->threads) schedule(static, 1) \
+    reduction(min:err)
+#endif
+    for (int i = 0; i < nblocks; i++) {
+	z_stream strm;
+	size_t off = (size_t) i * Z_PBLOCK;
+	uInt len = (uInt) ((n - off < Z_PBLOCK) ? n - off : Z_PBLOCK);
+	Byte *out = s->pout + (size_t) i * s->poutsize;
+	int res;
+
+	strm.zalloc = (alloc_func) 0;
+	strm.zfree = (free_func) 0;
+	strm.opaque = (voidpf) 0;
+	outlen[i] = 0;
+	res = deflateInit2(&strm, s->level, Z_DEFLATED, -MAX_WBITS,
+			   MAX_MEM_LEVEL, s->strategy);
+	if (res != Z_OK) { err = res; continue; }
+	strm.next_in = (Bytef *) buf + off;
+	strm.avail_in = len;
+	strm.next_out = out + Z_FHDR;
+	strm.avail_out = (uInt) (s->poutsize - Z_FHDR - 8);
+	res = deflate(&strm, Z_FINISH);
+	deflateEnd(&strm);
+	if (res != Z_STREAM_END) { err = Z_BUF_ERROR; continue; }
+	outlen[i] = Z_FHDR + strm.total_out + 8;
+	memcpy(out, gz_fhdr, Z_FHDR - 4);
+	z_putLE(out + Z_FHDR - 4, outlen[i]);
+	z_putLE(out + outlen[i] - 8, crc32(0L, buf + off, len));
+	z_putLE(out + outlen[i] - 4, len);
+    }
+    if (err != Z_OK) return err;
+
+    for (int i = 0; i < nblocks; i++) {
+	if (fwrite(s->pout + (size_t) i * s->poutsize, 1, outlen[i], s->file)
+	    != outlen[i])
+	    return Z_ERRNO;
+	s->out += outlen[i];
+    }
+    return Z_OK;
+}
+
+#ifdef R_GZ_THREADS
+static void *gz_pthread (void *arg)
+{
+    gz_stream *s = (gz_stream *) arg;
+    s->perr = gz_pcompress(s, s->pbuf2, s->pavail2);
+    return NULL;
+}
+#endif
+
+/* Wait for the blocks being compressed in the background, if any */
+static int gz_pwait (gz_stream *s)
+{
+#ifdef R_GZ_THREADS
+    if (s->pbusy) {
+	pthread_join(s->pthread, NULL);
+	s->pbusy = 0;
+	if (s->perr != Z_OK) s->z_err = s->perr;
+    }
+#endif
+    return s->perr;
+}
+
+/* Compress and write the pending blocks, in the background unless last */
+static int gz_pflush (gz_stream *s, int last)
+{
+    int err = gz_pwait(s);
+
+    if (err != Z_OK) return err;
+#ifdef R_GZ_THREADS
+    if (!last && s->pbuf2) {
+	Byte *tmp = s->pbuf2;
+	sigset_t all, old;
+
+	s->pbuf2 = s->pbuf;
+	s->pavail2 = s->pavail;
+	s->pbuf = tmp;
+	s->pavail = 0;
+	/* signals are for the main thread */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	s->pbusy = (pthread_create(&s->pthread, NULL, gz_pthread, s) == 0);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (s->pbusy) return Z_OK;
+	err = gz_pcompress(s, s->pbuf2, s->pavail2);
+    } else
+#endif
+    {
+	err = gz_pcompress(s, s->pbuf, s->pavail);
+	s->pavail = 0;
+    }
+    if (err != Z_OK) s->perr = s->z_err = err;
+    return err;
+}
+
+static int gz_pwrite (gz_stream *s, voidpc buf, unsigned len)
+{
+    const Byte *p = (const Byte *) buf;
+    size_t psize = (size_t) s->threads * Z_PBLOCK;
+    unsigned left = len;
+
+    while (left > 0) {
+	size_t n = psize - s->pavail;
+	if (n > left) n = left;
+	memcpy(s->pbuf + s->pavail, p, n);
+	s->pavail += n;
+	p += n;
+	left -= (unsigned) n;
+	if (s->pavail == psize && gz_pflush(s, 0) != Z_OK) break;
+    }
+    s->in += len - left;
+
+    return (int) (len - left);
+}
+
 static int R_gzwrite (gzFile file, voidpc buf, unsigned len)
 {
     gz_stream *s = (gz_stream*) file;
 
     if (s == NULL || s->mode != 'w') return Z_STREAM_ERROR;
+    if (s->threads > 1) return gz_pwrite(s, buf, len);
 
     s->stream.next_in = (Bytef*) buf;
     s->stream.avail_in = len;
@@ -470,15 +1106,45 @@ static int int_gzrewind (gzFile file)
     s->stream.next_in = s->buffer;
     s->crc = crc32(0L, Z_NULL, 0);
     if (!s->transparent) (void) inflateReset(&s->stream);
+    s->framed = 0; /* the first member is read by gz_read */
     s->in = 0;
     s->out = 0;
     return f_seek(s->file, s->start, SEEK_SET);
 }
 
+/* R ADDITION: read from now on the gzip member starting 'offset' bytes
+   into the file, as if the file started there.  Returns 0 for
+   success. */
+static int R_gzsetstart (gzFile file, Rz_off_t offset)
+{
+    gz_stream *s = (gz_stream*) file;
+
+    if (s == NULL || s->mode != 'r' || s->ra) return -1;
+    if (f_seek(s->file, offset, SEEK_SET) < 0) return -1;
+    s->z_err = Z_OK;
+    s->z_eof = 0;
+    s->stream.avail_in = 0;
+    s->stream.next_in = s->buffer;
+    s->crc = crc32(0L, Z_NULL, 0);
+    (void) inflateReset(&s->stream);
+    s->transparent = 0;
+    s->in = 0;
+    s->out = 0;
+    check_header(s);
+    if (s->transparent || s->z_err != Z_OK) return -1;
+    s->start = f_tell(s->file) - s->stream.avail_in;
+    return 0;
+}
+
 static Rz_off_t R_gztell (gzFile file)
 {
     gz_stream *s = (gz_stream*) file;
-    if (s->mode == 'w') return s->in; else return s->out;
+    if (s->mode == 'w') return s->in;
+    if (s->ra) {
+	gz_rastop(s);
+	return s->out - gz_rabuffered(s);
+    }
+    return s->out;
 }
 
 /* NB: return value is in line with fseeko, not gzseek */
@@ -486,6 +1152,15 @@ static int R_gzseek (gzFile file, Rz_off_t offset, int whence)
 {
     gz_stream *s = (gz_stream*) file;
 
+    if (s != NULL && s->ra) {
+	/* the position is that of the consumer, not the thread */
+	gz_rastop(s);
+	if (whence == SEEK_CUR) {
+	    offset += s->out - gz_rabuffered(s);
+	    whence = SEEK_SET;
+	}
+	gz_radiscard(s);
+    }
     if (s == NULL || whence == SEEK_END ||
         s->z_err == Z_ERRNO || s->z_err == Z_DATA_ERROR) return -1;
 
@@ -525,9 +1200,10 @@ static int R_gzseek (gzFile file, Rz_off_t offset, int whence)
 
     /* offset is now the number of bytes to skip. */
     while (offset > 0)  {
-        int size = Z_BUFSIZE;
+        int size = Z_BUFSIZE, nwarn[2];
         if (offset < Z_BUFSIZE) size = (int) offset;
-        size = R_gzread(file, s->buffer, (uInt) size);
+        size = gz_read(s, s->buffer, (uInt) size, nwarn);
+        gz_warn(nwarn);
         if (size <= 0) return -1;
         offset -= size;
     }
@@ -539,7 +1215,12 @@ int R_gzclose (gzFile file)
     gz_stream *s = (gz_stream*) file;
     if (s == NULL) return Z_STREAM_ERROR;
     if (s->mode == 'w') {
-        if (gz_flush (file, Z_FINISH) != Z_OK) 
+        if (s->threads > 1) {
+            /* the members are complete, with their trailers */
+            (void) gz_pflush(s, 1);
+            return destroy((gz_stream*) file);
+        }
+        if (gz_flush (file, Z_FINISH) != Z_OK)
 	    return destroy((gz_stream*) file);
         z_putLong (s->file, s->crc);
         z_putLong (s->file, (uLong) (s->in & 0xffffffff));
@@ -595,9 +1276,13 @@ R_uncompress(Bytef *dest, uLong *destLen, Bytef *source, uLong sourceLen,
             len -= stream.avail_in;
         }
         err = inflate(&stream, Z_NO_FLUSH);
+        /* R addition: go on to any further members of a gzip stream */
+        if (err == Z_STREAM_END && opt && stream.avail_in >= 2 &&
+            stream.next_in[0] == 0x1f && stream.next_in[1] == 0x8b)
+            err = inflateReset(&stream);
     } while (err == Z_OK);
 
-    *destLen = stream.total_out;
+    *destLen = (uLong) (stream.next_out - dest);
     inflateEnd(&stream);
     return err;
 }
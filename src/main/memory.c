@@ -277,6 +277,11 @@ static SEXPREC UnmarkedNodeTemplate;
 #define MARK_NODE(s) (MARK(s)=1)
 #define UNMARK_NODE(s) (MARK(s)=0)
 
+static Rboolean node_is_marked(SEXP s)
+{
+    return NODE_IS_MARKED(s) ? TRUE : FALSE;
+}
+
 
 /* Tuning Constants. Most of these could be made settable from R,
    within some reasonable constraints at least.  Since there are quite
@@ -1821,6 +1826,9 @@ static int RunGenCollect(R_size_t size_needed)
 
     DEBUG_CHECK_NODE_COUNTS("after processing forwarded list");
 
+    /* drop translations of CHARSXPs about to be freed */
+    R_SweepTranslationCache(node_is_marked);
+
     /* process CHARSXP cache */
     if (R_StringHash != NULL) /* in case of GC during initialization */
     {
@@ -1842,10 +1850,11 @@ static int RunGenCollect(R_size_t size_needed)
 		FORWARD_NODE(CXHEAD(s));
 		t = s;
 		s = CXTAIL(s);
+		nc++;
 	    }
-	    if(VECTOR_ELT(R_StringHash, i) != R_NilValue) nc++;
 	}
-	SET_TRUELENGTH(R_StringHash, nc); /* SET_HASHPRI, really */
+	/* SET_HASHPRI, really: the number of entries for this table */
+	SET_TRUELENGTH(R_StringHash, nc);
     }
     FORWARD_NODE(R_StringHash);
     PROCESS_NODES();
@@ -80,6 +80,7 @@
  *	"matprod"
  *      "PCRE_study"
  *      "PCRE_use_JIT"
+ *      "regex.cache.size"
 
  *
  * S additionally/instead has (and one might think about some)
@@ -273,9 +274,9 @@ void attribute_hidden InitOptions(void)
 
     /* options set here should be included into mandatory[] in do_options */
 #ifdef HAVE_RL_COMPLETION_MATCHES
-    PROTECT(v = val = allocList(23));
+    PROTECT(v = val = allocList(24));
 #else
-    PROTECT(v = val = allocList(22));
+    PROTECT(v = val = allocList(23));
 #endif
 
     SET_TAG(v, install("prompt"));
@@ -384,6 +385,10 @@ void attribute_hidden InitOptions(void)
     R_PCRE_limit_recursion = NA_LOGICAL;
     SETCAR(v, ScalarLogical(R_PCRE_limit_recursion));
     v = CDR(v);
+
+    SET_TAG(v, install("regex.cache.size"));
+    SETCAR(v, ScalarInteger(R_RegexCacheSize));
+    v = CDR(v);
     /* options set here should be included into mandatory[] in do_options */
 
 #ifdef HAVE_RL_COMPLETION_MATCHES
@@ -521,7 +526,7 @@ SEXP attribute_hidden do_options(SEXP call, SEXP op, SEXP args, SEXP rho)
 		  "keep.parse.data", "keep.parse.data.pkgs", "warning.length",
 		  "nwarnings", "OutDec", "browserNLdisabled", "CBoundsCheck",
 		  "matprod", "PCRE_study", "PCRE_use_JIT",
-		  "PCRE_limit_recursion", "rl_word_breaks",
+		  "PCRE_limit_recursion", "regex.cache.size", "rl_word_breaks",
 		  /* ^^^ from InitOptions ^^^ */
 		  "warn", "max.print", "show.error.messages",
 		  /* ^^^ from Common.R ^^^ */
@@ -811,6 +816,14 @@ SEXP attribute_hidden do_options(SEXP call, SEXP op, SEXP args, SEXP rho)
 		/* could warn for PCRE2 >= 10.30, but the value is ignored also when
 		   JIT is used  */
 	    }
+	    else if (streql(CHAR(namei), "regex.cache.size")) {
+		int k = asInteger(argi);
+		if (k == NA_INTEGER || k < 0)
+		    error(_("invalid value for '%s'"), CHAR(namei));
+		R_RegexCacheSize = k;
+		R_TrimRegexCache();
+		SET_VECTOR_ELT(value, i, SetOption(tag, ScalarInteger(k)));
+	    }
 	    else if (streql(CHAR(namei), "stringsAsFactors")) {
 		int strings_as_fact;
 		if (TYPEOF(argi) != LGLSXP || LENGTH(argi) != 1 ||
@@ -164,6 +164,26 @@ SEXP attribute_hidden do_paste(SEXP call, SEXP op, SEXP args, SEXP env)
 
     Rboolean allKnown, anyKnown, use_UTF8, use_Bytes;
 
+    /* For each argument, its length and the index of the element used
+       for the current result, so recycling needs no division, and
+       the (translated) element and its length, so each is translated
+       and measured once, in the first pass over the row. */
+    R_xlen_t *xlen = (R_xlen_t *) R_alloc(nx, sizeof(R_xlen_t)),
+	*xidx = (R_xlen_t *) R_alloc(nx, sizeof(R_xlen_t));
+    const char **xs = (const char **) R_alloc(nx, sizeof(char *));
+    size_t *xslen = (size_t *) R_alloc(nx, sizeof(size_t));
+    for (R_xlen_t j = 0; j < nx; j++) {
+	xlen[j] = XLENGTH(VECTOR_ELT(x, j));
+	xidx[j] = 0;
+    }
+    /* a "bytes" separator forces use_Bytes, so is never translated */
+    const char *u_csep = NULL;
+    if (use_sep && !sepBytes) {
+	u_csep = translateCharUTF8(sep);
+	u_sepw = (int) strlen(u_csep); // will be short
+    }
+    const void *vmax = vmaxget();
+
     for (R_xlen_t i = 0; i < maxlen; i++) {
 	/* Strategy for marking the encoding: if all inputs (including
 	 * the separator) are ASCII, so is the output and we don't
@@ -180,68 +200,58 @@ SEXP attribute_hidden do_paste(SEXP call, SEXP op, SEXP args, SEXP env)
 	}
 
 	for (R_xlen_t j = 0; j < nx; j++) {
-	    R_xlen_t k = XLENGTH(VECTOR_ELT(x, j));
-	    if (k > 0) {
-		SEXP cs = STRING_ELT(VECTOR_ELT(x, j), i % k);
+	    if (xlen[j] > 0) {
+		SEXP cs = STRING_ELT(VECTOR_ELT(x, j), xidx[j]);
 		if(IS_UTF8(cs)) use_UTF8 = TRUE;
 		if(IS_BYTES(cs)) use_Bytes = TRUE;
 	    }
 	}
 	if (use_Bytes) use_UTF8 = FALSE;
 	R_xlen_t pwidth = 0;
-	const void *vmax = vmaxget();
 	for (R_xlen_t j = 0; j < nx; j++) {
-	    R_xlen_t k = XLENGTH(VECTOR_ELT(x, j));
-	    if (k > 0) {
+	    if (xlen[j] > 0) {
+		SEXP cs = STRING_ELT(VECTOR_ELT(x, j), xidx[j]);
+		const char *s;
 		if(use_Bytes)
-		    pwidth += strlen(CHAR             (STRING_ELT(VECTOR_ELT(x, j), i % k)));
+		    s = CHAR(cs);
 		else if(use_UTF8)
-		    pwidth += strlen(translateCharUTF8(STRING_ELT(VECTOR_ELT(x, j), i % k)));
+		    s = translateCharUTF8(cs);
 		else
-		    pwidth += strlen(translateChar    (STRING_ELT(VECTOR_ELT(x, j), i % k)));
-		vmaxset(vmax);
+		    s = translateChar(cs);
+		/* untranslated strings are measured already */
+		xs[j] = s;
+		xslen[j] = (s == CHAR(cs)) ? LENGTH(cs) : strlen(s);
+		pwidth += xslen[j];
+		if (!use_UTF8) {
+		    allKnown = allKnown &&
+			(IS_ASCII(cs) || strIsASCII(s) || (ENC_KNOWN(cs)> 0));
+		    anyKnown = anyKnown || (ENC_KNOWN(cs)> 0);
+		}
 	    }
 	}
-	const char *u_csep = NULL;
-	if(use_sep) {
-	    if (use_UTF8 && !u_csep) {
-		u_csep = translateCharUTF8(sep);
-		u_sepw = (int) strlen(u_csep); // will be short
-	    }
+	if(use_sep)
 	    pwidth += (nx - 1) * (use_UTF8 ? u_sepw : sepw);
-	}
 	if (pwidth > INT_MAX)
 	    error(_("result would exceed 2^31-1 bytes"));
 	char *buf = R_AllocStringBuffer(pwidth, &cbuff);
 	const char *cbuf = buf;
-	vmax = vmaxget();
 	for (R_xlen_t j = 0; j < nx; j++) {
-	    R_xlen_t k = XLENGTH(VECTOR_ELT(x, j));
-	    if (k > 0) {
-		SEXP cs = STRING_ELT(VECTOR_ELT(x, j), i % k);
-		if (use_UTF8) {
-		    const char *s = translateCharUTF8(cs);
-		    strcpy(buf, s);
-		    buf += strlen(s);
-		} else {
-		    const char *s = use_Bytes ? CHAR(cs) : translateChar(cs);
-		    strcpy(buf, s);
-		    buf += strlen(s);
-		    allKnown = allKnown && (strIsASCII(s) || (ENC_KNOWN(cs)> 0));
-		    anyKnown = anyKnown || (ENC_KNOWN(cs)> 0);
-		}
+	    if (xlen[j] > 0) {
+		memcpy(buf, xs[j], xslen[j]);
+		buf += xslen[j];
+		if (++xidx[j] == xlen[j]) xidx[j] = 0;
 	    }
 	    if (sepw != 0 && j != nx - 1) {
 		if (use_UTF8) {
-		    strcpy(buf, u_csep);
+		    memcpy(buf, u_csep, u_sepw);
 		    buf += u_sepw;
 		} else {
-		    strcpy(buf, csep);
+		    memcpy(buf, csep, sepw);
 		    buf += sepw;
 		}
 	    }
-	    vmax = vmaxget();
 	}
+	vmaxset(vmax);
 	int ienc = 0;
 	if(use_UTF8) ienc = CE_UTF8;
 	else if(use_Bytes) ienc = CE_BYTES;
@@ -249,7 +259,7 @@ SEXP attribute_hidden do_paste(SEXP call, SEXP op, SEXP args, SEXP env)
 	    if(known_to_be_latin1) ienc = CE_LATIN1;
 	    if(known_to_be_utf8) ienc = CE_UTF8;
 	}
-	SET_STRING_ELT(ans, i, mkCharCE(cbuf, ienc));
+	SET_STRING_ELT(ans, i, mkCharLenCE(cbuf, (int) pwidth, ienc));
     }
 
     /* Now collapse, if required. */
@@ -279,7 +289,7 @@ SEXP attribute_hidden do_paste(SEXP call, SEXP op, SEXP args, SEXP env)
 		pwidth += strlen(translateCharUTF8(STRING_ELT(ans, i)));
 		vmaxset(vmax);
 	    } else /* already translated */
-		pwidth += strlen(CHAR(STRING_ELT(ans, i)));
+		pwidth += LENGTH(STRING_ELT(ans, i));
 	pwidth += (nx - 1) * sepw;
 	if (pwidth > INT_MAX)
 	    error(_("result would exceed 2^31-1 bytes"));
@@ -288,17 +298,20 @@ SEXP attribute_hidden do_paste(SEXP call, SEXP op, SEXP args, SEXP env)
 	vmax = vmaxget();
 	for (R_xlen_t i = 0; i < nx; i++) {
 	    if(i > 0) {
-		strcpy(buf, csep);
+		memcpy(buf, csep, sepw);
 		buf += sepw;
 	    }
 	    const char *s;
-	    if(use_UTF8)
+	    size_t len;
+	    if(use_UTF8) {
 		s = translateCharUTF8(STRING_ELT(ans, i));
-	    else /* already translated */
+		len = strlen(s);
+	    } else { /* already translated */
 		s = CHAR(STRING_ELT(ans, i));
-	    strcpy(buf, s);
-	    while (*buf)
-		buf++;
+		len = LENGTH(STRING_ELT(ans, i));
+	    }
+	    memcpy(buf, s, len);
+	    buf += len;
 	    allKnown = allKnown &&
 		(strIsASCII(s) || (ENC_KNOWN(STRING_ELT(ans, i)) > 0));
 	    anyKnown = anyKnown || (ENC_KNOWN(STRING_ELT(ans, i)) > 0);
@@ -313,7 +326,7 @@ SEXP attribute_hidden do_paste(SEXP call, SEXP op, SEXP args, SEXP env)
 	    if(known_to_be_utf8) ienc = CE_UTF8;
 	}
 	PROTECT(ans = allocVector(STRSXP, 1));
-	SET_STRING_ELT(ans, 0, mkCharCE(cbuf, ienc));
+	SET_STRING_ELT(ans, 0, mkCharLenCE(cbuf, (int) pwidth, ienc));
     }
     R_FreeStringBufferL(&cbuff);
     UNPROTECT(1);
@@ -1976,6 +1976,7 @@ SEXP attribute_hidden do_setlocale(SEXP call, SEXP op, SEXP args, SEXP rho)
     UNPROTECT(1);
     R_check_locale();
     invalidate_cached_recodings();
+    R_FlushRegexCache();
     return ans;
 }
 
@@ -3196,6 +3197,9 @@ SEXP attribute_hidden do_mkjunction(SEXP call, SEXP op, SEXP args, SEXP rho)
 #include <zlib.h>
 #include <bzlib.h>
 #include <lzma.h>
+#ifdef HAVE_ZSTD
+# include <zstd.h>
+#endif
 
 #ifdef HAVE_PCRE2
   /* PCRE2_CODE_UNIT_WIDTH is defined to 8 via config.h */
@@ -3254,8 +3258,8 @@ SEXP attribute_hidden
 do_eSoftVersion(SEXP call, SEXP op, SEXP args, SEXP rho)
 {
     checkArity(op, args);
-    SEXP ans = PROTECT(allocVector(STRSXP, 9));
-    SEXP nms = PROTECT(allocVector(STRSXP, 9));
+    SEXP ans = PROTECT(allocVector(STRSXP, 10));
+    SEXP nms = PROTECT(allocVector(STRSXP, 10));
     setAttrib(ans, R_NamesSymbol, nms);
     unsigned int i = 0;
     char p[256];
@@ -3268,6 +3272,13 @@ do_eSoftVersion(SEXP call, SEXP op, SEXP args, SEXP rho)
     snprintf(p, 256, "%s", lzma_version_string());
     SET_STRING_ELT(ans, i, mkChar(p));
     SET_STRING_ELT(nms, i++, mkChar("xz"));
+#ifdef HAVE_ZSTD
+    snprintf(p, 256, "%s", ZSTD_versionString());
+    SET_STRING_ELT(ans, i, mkChar(p));
+#else
+    SET_STRING_ELT(ans, i, mkChar(""));
+#endif
+    SET_STRING_ELT(nms, i++, mkChar("zstd"));
 #ifdef HAVE_PCRE2
     pcre2_config(PCRE2_CONFIG_VERSION, p);
 #else
@@ -177,7 +177,7 @@ const char *EncodeReal(double x, int w, int d, int e, char cdec)
 const char *EncodeReal0(double x, int w, int d, int e, const char *dec)
 {
     static char buff[NB], buff2[2*NB];
-    char fmt[20], *out = buff;
+    char *out = buff;
 
     /* IEEE allows signed zeros (yuck!) */
     if (x == 0.0) x = 0.0;
@@ -187,20 +187,8 @@ const char *EncodeReal0(double x, int w, int d, int e, const char *dec)
 	else if(x > 0) snprintf(buff, NB, "%*s", min(w, (NB-1)), "Inf");
 	else snprintf(buff, NB, "%*s", min(w, (NB-1)), "-Inf");
     }
-    else if (e) {
-	if(d) {
-	    sprintf(fmt,"%%#%d.%de", min(w, (NB-1)), d);
-	    snprintf(buff, NB, fmt, x);
-	}
-	else {
-	    sprintf(fmt,"%%%d.%de", min(w, (NB-1)), d);
-	    snprintf(buff, NB, fmt, x);
-	}
-    }
-    else { /* e = 0 */
-	sprintf(fmt,"%%%d.%df", min(w, (NB-1)), d);
-	snprintf(buff, NB, fmt, x);
-    }
+    else /* as sprintf("%#w.de" or "%w.df"), but faster */
+	R_sprintReal(buff, NB, x, min(w, (NB-1)), d, (Rboolean) e, FALSE);
     buff[NB-1] = '\0';
 
     if(strcmp(dec, ".")) {
@@ -220,7 +208,7 @@ static const char
 *EncodeRealDrop0(double x, int w, int d, int e, const char *dec)
 {
     static char buff[NB], buff2[2*NB];
-    char fmt[20], *out = buff;
+    char *out = buff;
 
     /* IEEE allows signed zeros (yuck!) */
     if (x == 0.0) x = 0.0;
@@ -230,20 +218,8 @@ static const char
 	else if(x > 0) snprintf(buff, NB, "%*s", min(w, (NB-1)), "Inf");
 	else snprintf(buff, NB, "%*s", min(w, (NB-1)), "-Inf");
     }
-    else if (e) {
-	if(d) {
-	    sprintf(fmt,"%%#%d.%de", min(w, (NB-1)), d);
-	    snprintf(buff, NB, fmt, x);
-	}
-	else {
-	    sprintf(fmt,"%%%d.%de", min(w, (NB-1)), d);
-	    snprintf(buff, NB, fmt, x);
-	}
-    }
-    else { /* e = 0 */
-	sprintf(fmt,"%%%d.%df", min(w, (NB-1)), d);
-	snprintf(buff, NB, fmt, x);
-    }
+    else /* as sprintf("%#w.de" or "%w.df"), but faster */
+	R_sprintReal(buff, NB, x, min(w, (NB-1)), d, (Rboolean) e, FALSE);
     buff[NB-1] = '\0';
 
     // Drop trailing zeroes
@@ -286,7 +262,6 @@ attribute_hidden
 const char *EncodeReal2(double x, int w, int d, int e)
 {
     static char buff[NB];
-    char fmt[20];
 
     /* IEEE allows signed zeros (yuck!) */
     if (x == 0.0) x = 0.0;
@@ -296,20 +271,8 @@ const char *EncodeReal2(double x, int w, int d, int e)
 	else if(x > 0) snprintf(buff, NB, "%*s", min(w, (NB-1)), "Inf");
 	else snprintf(buff, NB, "%*s", min(w, (NB-1)), "-Inf");
     }
-    else if (e) {
-	if(d) {
-	    sprintf(fmt,"%%#%d.%de", min(w, (NB-1)), d);
-	    snprintf(buff, NB, fmt, x);
-	}
-	else {
-	    sprintf(fmt,"%%%d.%de", min(w, (NB-1)), d);
-	    snprintf(buff, NB, fmt, x);
-	}
-    }
-    else { /* e = 0 */
-	sprintf(fmt,"%%#%d.%df", min(w, (NB-1)), d);
-	snprintf(buff, NB, fmt, x);
-    }
+    else /* as sprintf("%#w.de" or "%#w.df"), but faster */
+	R_sprintReal(buff, NB, x, min(w, (NB-1)), d, (Rboolean) e, !e);
     buff[NB-1] = '\0';
     return buff;
 }
@@ -1829,13 +1829,17 @@ static int R_ReadMagic(FILE *fp)
     else if (strncmp((char*)buf, "RDX2\n", 5) == 0) {
 	return R_MAGIC_XDR_V2;
     }
-    if (strncmp((char*)buf, "RDA3\n", 5) == 0) {
+    /* the serialization header gives the version from 3 on */
+    if (strncmp((char*)buf, "RDA3\n", 5) == 0 ||
+	strncmp((char*)buf, "RDA4\n", 5) == 0) {
 	return R_MAGIC_ASCII_V3;
     }
-    else if (strncmp((char*)buf, "RDB3\n", 5) == 0) {
+    else if (strncmp((char*)buf, "RDB3\n", 5) == 0 ||
+	     strncmp((char*)buf, "RDB4\n", 5) == 0) {
 	return R_MAGIC_BINARY_V3;
     }
-    else if (strncmp((char*)buf, "RDX3\n", 5) == 0) {
+    else if (strncmp((char*)buf, "RDX3\n", 5) == 0 ||
+	     strncmp((char*)buf, "RDX4\n", 5) == 0) {
 	return R_MAGIC_XDR_V3;
     }
     else if (strncmp((char *)buf, "RD", 2) == 0)
@@ -1858,7 +1862,7 @@ static int defaultSaveVersion()
 	int val = -1;
 	if (valstr != NULL)
 	    val = atoi(valstr);
-	if (val == 2 || val == 3)
+	if (val >= 2 && val <= 4)
 	    dflt = val;
 	else
 	    dflt = 3; /* the default */
@@ -2474,7 +2478,10 @@ SEXP attribute_hidden do_loadFromConn2(SEXP call, SEXP op, SEXP args, SEXP env)
 	strncmp((char*)buf, "RDX2\n", 5) == 0 ||
 	strncmp((char*)buf, "RDA3\n", 5) == 0 ||
 	strncmp((char*)buf, "RDB3\n", 5) == 0 ||
-	strncmp((char*)buf, "RDX3\n", 5) == 0) {
+	strncmp((char*)buf, "RDX3\n", 5) == 0 ||
+	strncmp((char*)buf, "RDA4\n", 5) == 0 ||
+	strncmp((char*)buf, "RDB4\n", 5) == 0 ||
+	strncmp((char*)buf, "RDX4\n", 5) == 0) {
 	R_InitConnInPStream(&in, con, R_pstream_any_format, NULL, NULL);
 	if (PRIMVAL(op) == 0) {
 	    int old_InitReadItemDepth = R_InitReadItemDepth,
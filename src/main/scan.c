@@ -665,9 +665,621 @@ static SEXP scanVector(SEXPTYPE type, R_xlen_t maxitems, R_xlen_t maxlines,
 }
 
 
+/* ---------- reading records in blocks, parsed in parallel ----------
+
+   When scanFrame() is asked to use threads > 1 and will read whole
+   records to the end of a connection which can be read in blocks (see
+   Rconn_readblock), it reads the rest of the input a block at a time.
+   Each block is split into chunks just after line ends which are not
+   within quoted strings or comments, and the chunks are parsed
+   concurrently into malloc-ed buffers by code which mirrors
+   fillBuffer() and extractItem() without using the R API.  Then the
+   chunks are copied into the result in order: the strings are made
+   there, and any field which the chunk parser could not convert is
+   passed to extractItem(), so the values, errors and warnings are
+   those of reading a character at a time.  Should a chunk not end at a
+   line end after all (the splitting only looks at quotes and comments,
+   not at the column types), it and the rest of the block are parsed
+   again as one chunk.
+*/
+
+#define SCAN_BLOCK (4 << 20)	/* bytes read per thread at a time */
+#define SCAN_CHUNKS 4		/* chunks per thread in a block */
+#define SCAN_NOSAVE -1000	/* as Rconnection.save */
+
+typedef struct {
+    char *text;			/* a field left to extractItem() */
+    int col;
+    R_xlen_t row;
+} ScanDeferred;
+
+typedef struct {
+    char *r, *end;		/* unread text of the chunk */
+    char *stop;			/* end at the first line start from here */
+    char *base, *out;		/* the block, and where fields are put */
+    Rboolean last;		/* does the chunk end the input? */
+    int save;			/* as LocalData.save */
+    int save2;			/* as Rconnection.save in Rconn_fgetc */
+    void **cols;		/* int, double or char * values per column */
+    R_xlen_t n, cap;		/* records read and allocated */
+    ScanDeferred *defer;
+    R_xlen_t ndefer, capdefer;
+    R_xlen_t lines;		/* line ends read */
+    R_xlen_t badline;		/* a line with too few items, or 0 */
+    int partial;		/* items in an incomplete last record */
+    int eofquote;		/* number of EOF-within-quote warnings */
+    Rboolean split;		/* text ended within a line */
+    Rboolean nomem;
+    Rboolean nul;		/* was an embedded nul seen? */
+} ScanChunk;
+
+typedef struct {
+    int nc;
+    SEXPTYPE *types;
+    int *strip;			/* per column, or NULL */
+    int strip1;
+    int fill, blskip;
+    const char **na;		/* na.strings */
+    int nna;
+    Rboolean quotes;		/* can any column be quoted? */
+} ScanSpec;
+
+typedef struct {
+    char *buf, *out;
+    char **split;
+    ScanChunk *chunks;
+    int nchunks, nc;
+} ScanBlocks;
+
+/* As Rconn_fgetc() and scanchar_raw() */
+static R_INLINE int chunk_raw(ScanChunk *k, LocalData *d)
+{
+    int c;
+
+    if (k->save2 != SCAN_NOSAVE) {
+	c = k->save2;
+	k->save2 = SCAN_NOSAVE;
+    } else if (k->r >= k->end) {
+	if (!k->last) k->split = TRUE;
+	return R_EOF;
+    } else {
+	c = (unsigned char) *k->r++;
+	if (c == '\r') {
+	    /* a CR LF may continue in the next block */
+	    if (k->r >= k->end && !k->last) {
+		k->split = TRUE;
+		return R_EOF;
+	    }
+	    c = (k->r < k->end) ? (unsigned char) *k->r++ : R_EOF;
+	    if (c != '\n') {
+		k->save2 = (c != '\r') ? c : '\n';
+		return '\n';
+	    }
+	}
+    }
+    if (c == 0) {
+	if (d->skipNul) {
+	    do
+		c = chunk_raw(k, d);
+	    while (c == 0);
+	} else k->nul = TRUE;
+    }
+    return c;
+}
+
+/* As scanchar(), which with escapes is not used */
+static R_INLINE int chunk_char(ScanChunk *k, Rboolean inQuote, LocalData *d)
+{
+    int next;
+
+    if (k->save) {
+	next = k->save;
+	k->save = 0;
+    } else
+	next = chunk_raw(k, d);
+    if (next == d->comchar && !inQuote) {
+	do
+	    next = chunk_raw(k, d);
+	while (next != '\n' && next != R_EOF);
+    }
+    return next;
+}
+
+/* As fillBuffer() outside a DBCS locale.  The field is put at the same
+   offset in the output as its text (starting with any character pushed
+   back), which is never shorter. */
+static char *
+chunk_field(ScanChunk *k, SEXPTYPE type, int strip, int *bch, LocalData *d)
+{
+    char *buf = k->out + (k->r - k->base) -
+	((k->save || k->save2 != SCAN_NOSAVE) ? 1 : 0);
+    char *bufp;
+    int c, quote, filled = 1, m = 0, mm = 0;
+
+    if (d->sepchar == 0) {
+	strip = 0;
+	while ((c = chunk_char(k, FALSE, d)) == ' ' || c == '\t') ;
+	if (c == '\n' || c == '\r' || c == R_EOF) {
+	    filled = c;
+	    goto donefill;
+	}
+	if ((type == STRSXP || type == NILSXP) && strchr(d->quoteset, c)) {
+	    quote = c;
+	    while ((c = chunk_char(k, TRUE, d)) != R_EOF && c != quote) {
+		if (c == '\\') {
+		    c = chunk_char(k, TRUE, d);
+		    if (c == R_EOF) break;
+		    if (c != quote) buf[m++] = '\\';
+		}
+		buf[m++] = (char) c;
+	    }
+	    if (c == R_EOF) k->eofquote++;
+	    c = chunk_char(k, FALSE, d);
+	    mm = m;
+	} else {
+	    do {
+		buf[m++] = (char) c;
+		c = chunk_char(k, FALSE, d);
+	    } while (!Rspace(c) && c != R_EOF);
+	}
+	while (c == ' ' || c == '\t') c = chunk_char(k, FALSE, d);
+	if (c == '\n' || c == '\r' || c == R_EOF)
+	    filled = c;
+	else
+	    k->save = c;
+    } else {
+	while ((c = chunk_char(k, FALSE, d)) != d->sepchar &&
+	       c != '\n' && c != '\r' && c != R_EOF) {
+	    if (type != STRSXP)
+		while (c == ' ' || c == '\t')
+		    if ((c = chunk_char(k, FALSE, d)) == d->sepchar
+			|| c == '\n' || c == '\r' || c == R_EOF) {
+			filled = c;
+			goto donefill;
+		    }
+	    if ((type == STRSXP || type == NILSXP)
+		&& c != 0 && strchr(d->quoteset, c)) {
+		quote = c;
+	    inquote:
+		while ((c = chunk_char(k, TRUE, d)) != R_EOF && c != quote)
+		    buf[m++] = (char) c;
+		if (c == R_EOF) k->eofquote++;
+		c = chunk_char(k, TRUE, d);
+		if (c == quote) {
+		    buf[m++] = (char) quote;
+		    goto inquote;
+		}
+		mm = m;
+		if (c == d->sepchar || c == '\n' || c == '\r' || c == R_EOF) {
+		    filled = c;
+		    goto donefill;
+		} else {
+		    k->save = c;
+		    continue;
+		}
+	    }
+	    if (!strip || m > 0 || !Rspace(c))
+		buf[m++] = (char) c;
+	}
+	filled = c;
+    }
+ donefill:
+    bufp = &buf[m];
+    if (strip && m > mm) {
+	do {c = (int)*--bufp;} while(m-- > mm && Rspace(c));
+	bufp++;
+    }
+    /* at the end of a chunk which ends within a line, this would
+       overwrite the first field of the next chunk */
+    if (!k->split) *bufp = '\0';
+    *bch = filled;
+    return buf;
+}
+
+static Rboolean chunk_room(ScanChunk *k, ScanSpec *sp)
+{
+    if (k->n < k->cap) return TRUE;
+    R_xlen_t cap = k->cap ? 2 * k->cap : 1024;
+    for (int j = 0; j < sp->nc; j++) {
+	size_t size;
+	switch (sp->types[j]) {
+	case LGLSXP:
+	case INTSXP: size = sizeof(int); break;
+	case REALSXP: size = sizeof(double); break;
+	case STRSXP: size = sizeof(char *); break;
+	default: continue;
+	}
+	void *p = realloc(k->cols[j], cap * size);
+	if (!p) {
+	    k->nomem = TRUE;
+	    return FALSE;
+	}
+	k->cols[j] = p;
+    }
+    k->cap = cap;
+    return TRUE;
+}
+
+static void chunk_defer(ScanChunk *k, char *text, int col)
+{
+    if (k->ndefer == k->capdefer) {
+	R_xlen_t cap = k->capdefer ? 2 * k->capdefer : 64;
+	ScanDeferred *p = realloc(k->defer, cap * sizeof(ScanDeferred));
+	if (!p) {
+	    k->nomem = TRUE;
+	    return;
+	}
+	k->defer = p;
+	k->capdefer = cap;
+    }
+    k->defer[k->ndefer].text = text;
+    k->defer[k->ndefer].col = col;
+    k->defer[k->ndefer++].row = k->n;
+}
+
+static int chunk_isNA(const char *buf, int mode, ScanSpec *sp)
+{
+    if (!mode && !*buf) return 1;
+    for (int i = 0; i < sp->nna; i++)
+	if (!strcmp(sp->na[i], buf)) return 1;
+    return 0;
+}
+
+/* As extractItem(), but leaving to it what is not simply converted */
+static void chunk_item(ScanChunk *k, char *buffer, int col, ScanSpec *sp,
+		       LocalData *d)
+{
+    R_xlen_t i = k->n;
+    char *endp;
+    const char *p;
+
+    switch (sp->types[col]) {
+    case LGLSXP:
+	if (chunk_isNA(buffer, 0, sp))
+	    ((int *) k->cols[col])[i] = NA_LOGICAL;
+	else {
+	    int tr = StringTrue(buffer), fa = StringFalse(buffer);
+	    if (tr || fa) ((int *) k->cols[col])[i] = tr;
+	    else chunk_defer(k, buffer, col);
+	}
+	break;
+    case INTSXP:
+	if (chunk_isNA(buffer, 0, sp))
+	    ((int *) k->cols[col])[i] = NA_INTEGER;
+	else if ((((int *) k->cols[col])[i] = Strtoi(buffer, 10))
+		 == NA_INTEGER)
+	    chunk_defer(k, buffer, col);
+	break;
+    case REALSXP:
+	if (chunk_isNA(buffer, 0, sp))
+	    ((double *) k->cols[col])[i] = NA_REAL;
+	else {
+	    ((double *) k->cols[col])[i] = Strtod(buffer, &endp, TRUE, d);
+	    /* isBlankString() for ASCII: leave the rest to it */
+	    for (p = endp; *p; p++)
+		if (!(*p == ' ' || (*p >= '\t' && *p <= '\r'))) {
+		    chunk_defer(k, buffer, col);
+		    break;
+		}
+	}
+	break;
+    case STRSXP:
+	((char **) k->cols[col])[i] =
+	    chunk_isNA(buffer, 1, sp) ? NULL : buffer;
+	break;
+    default:
+	break;
+    }
+}
+
+/* As the loop of scanFrame() for whole records */
+static void scanChunk(ScanChunk *k, ScanSpec *sp, LocalData *d)
+{
+    int bch = 1, colsread = 0;
+    char *buffer;
+
+    for (;;) {
+	if (bch == R_EOF)
+	    break;
+	else if (bch == '\n') {
+	    k->lines++;
+	    if (colsread != 0) {
+		if (!sp->fill) {
+		    k->badline = k->lines;
+		    return;
+		}
+		for (int ii = colsread; ii < sp->nc; ii++)
+		    chunk_item(k, "", ii, sp, d);
+		k->n++;
+		colsread = 0;
+	    }
+	    if (!k->last && k->r >= k->stop && k->save2 == SCAN_NOSAVE)
+		return;
+	}
+	if (!chunk_room(k, sp)) return;
+	buffer = chunk_field(k, sp->types[colsread],
+			     sp->strip ? sp->strip[colsread] : sp->strip1,
+			     &bch, d);
+	if (k->split) return;
+	if (colsread == 0 && !*buffer &&
+	    ((sp->blskip && bch == '\n') || bch == R_EOF)) {
+	    if (bch == R_EOF) break;
+	} else {
+	    chunk_item(k, buffer, colsread, sp, d);
+	    if (k->nomem) return;
+	    if (++colsread == sp->nc) {
+		k->n++;
+		colsread = 0;
+	    }
+	}
+    }
+    if (colsread != 0) { /* only at the end of the input */
+	k->partial = colsread;
+	for (int ii = colsread; ii < sp->nc; ii++)
+	    chunk_item(k, "", ii, sp, d);
+	k->n++;
+    }
+}
+
+/* Set in split[] up to nsplit places in [p, end) at which to split it
+   into chunks of about equal size, each just after a line end which is
+   not within a quoted string or a comment, and return the last such
+   place (or NULL) */
+static char *
+scanSplit(char *p, char *end, char **split, int *nsplit, ScanSpec *sp,
+	  LocalData *d)
+{
+    size_t target = (end - p) / (*nsplit + 1) + 1;
+    char *s, *last = NULL, *next = p + target;
+    int c, q = 0, ns = 0, start = 1;
+    Rboolean inq = FALSE;
+
+    if (!sp->quotes && d->comchar == NO_COMCHAR) {
+	/* just line ends */
+	while (ns < *nsplit && next < end &&
+	       (s = memchr(next - 1, '\n', end - next + 1))) {
+	    split[ns++] = s + 1;
+	    next = s + 1 + target;
+	}
+	for (s = end - 1; s >= p; s--)
+	    if (*s == '\n') {
+		last = s + 1;
+		break;
+	    }
+    } else {
+	for (s = p; s < end; s++) {
+	    c = (unsigned char) *s;
+	    if (inq) {
+		if (c == q) {
+		    inq = FALSE;
+		    start = 1;
+		} else if (c == '\\' && d->sepchar == 0) {
+		    s++;
+		    if (d->skipNul) while (s < end && !*s) s++;
+		}
+		continue;
+	    }
+	    if (c == d->comchar) {
+		/* to a line end, which CR also is */
+		while (s < end && *s != '\n' && *s != '\r') s++;
+		if (s == end) break;
+		c = (unsigned char) *s;
+	    }
+	    if (c == 0 && d->skipNul) continue;
+	    if (c == '\n') {
+		last = s + 1;
+		if (last >= next && ns < *nsplit) {
+		    split[ns++] = last;
+		    next = last + target;
+		}
+		start = 1;
+	    } else if (sp->quotes && strchr(d->quoteset, c) &&
+		       (d->sepchar ? c != 0 : start)) {
+		q = c;
+		inq = TRUE;
+	    } else
+		/* without a separator, quotes open only at the start of a
+		   field */
+		start = (c == ' ' || c == '\t' || c == '\r');
+	}
+    }
+    while (ns > 0 && (!last || split[ns - 1] >= last)) ns--;
+    *nsplit = ns;
+    return last;
+}
+
+static void scanBlocksCleanup(void *data)
+{
+    ScanBlocks *b = data;
+
+    if (b->chunks)
+	for (int j = 0; j < b->nchunks; j++) {
+	    ScanChunk *k = b->chunks + j;
+	    if (k->cols) {
+		for (int i = 0; i < b->nc; i++) free(k->cols[i]);
+		free(k->cols);
+	    }
+	    free(k->defer);
+	}
+    free(b->chunks);
+    free(b->split);
+    free(b->out);
+    free(b->buf);
+}
+
+/* Copy the records of a chunk to those of ans from n, returning the new
+   number of records */
+static R_xlen_t
+mergeChunk(ScanChunk *k, SEXP ans, R_xlen_t *blksize, R_xlen_t n,
+	   R_xlen_t linesread, ScanSpec *sp, LocalData *d)
+{
+    SEXP old, new, col;
+    R_xlen_t i;
+
+    if (n + k->n > *blksize) {
+	while (n + k->n > *blksize) {
+	    if(*blksize > R_XLEN_T_MAX/2) error(_("too many items"));
+	    *blksize = 2 * *blksize;
+	}
+	for (int j = 0; j < sp->nc; j++) {
+	    old = VECTOR_ELT(ans, j);
+	    if(!isNull(old)) {
+		new = allocVector(TYPEOF(old), *blksize);
+		copyVector(new, old);
+		SET_VECTOR_ELT(ans, j, new);
+	    }
+	}
+    }
+    for (int j = 0; j < sp->nc; j++) {
+	col = VECTOR_ELT(ans, j);
+	switch (sp->types[j]) {
+	case LGLSXP:
+	case INTSXP:
+	    if (k->n) memcpy(INTEGER(col) + n, k->cols[j], k->n * sizeof(int));
+	    break;
+	case REALSXP:
+	    if (k->n) memcpy(REAL(col) + n, k->cols[j], k->n * sizeof(double));
+	    break;
+	case STRSXP:
+	{
+	    char **s = k->cols[j];
+	    for (i = 0; i < k->n; i++)
+		SET_STRING_ELT(col, n + i,
+			       s[i] ? insertString(s[i], d) : NA_STRING);
+	    break;
+	}
+	default:
+	    break;
+	}
+    }
+    for (i = 0; i < k->ndefer; i++)
+	extractItem(k->defer[i].text, VECTOR_ELT(ans, k->defer[i].col),
+		    n + k->defer[i].row, d);
+    if (k->badline)
+	error(_("line %lld did not have %lld elements"),
+	      (long long) (linesread + k->badline), (long long) sp->nc);
+    if (k->nomem)
+	error(_("cannot allocate buffer in scan()"));
+    for (int j = 0; j < k->eofquote; j++)
+	warning(_("EOF within quoted string"));
+    if (k->partial && !sp->fill)
+	warning(_("number of items read is not a multiple of the number of columns"));
+    if (k->nul) d->embedWarn = TRUE;
+    return n + k->n;
+}
+
+/* The bytes read per thread, which the regression tests make small */
+static size_t scanBlockSize(void)
+{
+    const char *p = getenv("_R_SCAN_BLOCK_");
+    long size = p ? atol(p) : 0;
+    return (size > 0 && size <= SCAN_BLOCK) ? (size_t) size : SCAN_BLOCK;
+}
+
+/* Read the rest of the input in blocks, from a line start, returning
+   the number of records in ans, or -1 if the connection cannot be read
+   in blocks */
+static R_xlen_t
+scanBlocks(SEXP ans, R_xlen_t *blksize, R_xlen_t n, R_xlen_t *linesread,
+	   int threads, ScanSpec *sp, LocalData *d)
+{
+    ScanBlocks b = {NULL, NULL, NULL, NULL, threads * SCAN_CHUNKS, sp->nc};
+    size_t cap = (size_t) threads * scanBlockSize(), len = 0;
+    R_xlen_t got;
+    Rboolean eof, whole = FALSE;
+    char *end, *tmp;
+    int j, ns, nk;
+    RCNTXT cntxt;
+
+    if (d->save || Rconn_readblock(d->con, NULL, 0) < 0) return -1;
+
+    begincontext(&cntxt, CTXT_CCODE, R_NilValue, R_BaseEnv, R_BaseEnv,
+		 R_NilValue, R_NilValue);
+    cntxt.cend = &scanBlocksCleanup;
+    cntxt.cenddata = &b;
+    b.buf = malloc(cap);
+    b.out = malloc(cap + 1);
+    b.split = malloc(b.nchunks * sizeof(char *));
+    b.chunks = calloc(b.nchunks, sizeof(ScanChunk));
+    if (!b.buf || !b.out || !b.split || !b.chunks)
+	error(_("cannot allocate buffer in scan()"));
+    for (j = 0; j < b.nchunks; j++)
+	if (!(b.chunks[j].cols = calloc(sp->nc, sizeof(void *))))
+	    error(_("cannot allocate buffer in scan()"));
+
+    got = Rconn_readblock(d->con, b.buf, cap);
+    for (;;) {
+	len += got;
+	eof = len < cap;
+	if (!len) break;
+	/* 'whole' parses the block as one chunk, after a failed split */
+	ns = 0;
+	end = b.buf + len;
+	if (!whole) {
+	    ns = b.nchunks - 1;
+	    end = scanSplit(b.buf, b.buf + len, b.split, &ns, sp, d);
+	    if (eof) end = b.buf + len;
+	}
+	if (end) {
+	    nk = ns + 1;
+	    for (j = 0; j < nk; j++) {
+		ScanChunk *k = b.chunks + j;
+		k->r = j ? b.split[j - 1] : b.buf;
+		k->end = (j < ns) ? b.split[j] : end;
+		k->stop = whole ? b.buf + len/2 : k->end;
+		k->last = eof && j == ns;
+		k->base = b.buf;
+		k->out = b.out;
+		k->save = 0;
+		k->save2 = SCAN_NOSAVE;
+		k->n = k->ndefer = k->lines = k->badline = 0;
+		k->partial = k->eofquote = 0;
+		k->split = k->nomem = k->nul = FALSE;
+	    }
+#ifdef _OPENMP
+# pragma omp parallel for num_threads(threads) schedule(dynamic)
+#endif
+	    for (j = 0; j < nk; j++)
+		scanChunk(b.chunks + j, sp, d);
+	    for (j = 0; j < nk && !b.chunks[j].split; j++) {
+		n = mergeChunk(b.chunks + j, ans, blksize, n, *linesread,
+			       sp, d);
+		*linesread += b.chunks[j].lines;
+	    }
+	    if (j == nk) {
+		if (eof) break;
+		if (whole) end = b.chunks[0].r;
+		whole = FALSE;
+	    } else if (!whole) {
+		end = j ? b.split[j - 1] : b.buf;
+		whole = TRUE;
+	    } else end = NULL;
+	}
+	if (!end) {
+	    /* no whole line: read a larger block */
+	    if (!(tmp = realloc(b.buf, 2 * cap)))
+		error(_("cannot allocate buffer in scan()"));
+	    b.buf = tmp;
+	    if (!(tmp = realloc(b.out, 2 * cap + 1)))
+		error(_("cannot allocate buffer in scan()"));
+	    b.out = tmp;
+	    got = Rconn_readblock(d->con, b.buf + len, cap);
+	    cap *= 2;
+	    continue;
+	}
+	R_CheckUserInterrupt();
+	len = b.buf + len - end;
+	memmove(b.buf, end, len);
+	got = Rconn_readblock(d->con, b.buf + len, cap - len);
+    }
+    endcontext(&cntxt);
+    scanBlocksCleanup(&b);
+    return n;
+}
+
 static SEXP scanFrame(SEXP what, R_xlen_t maxitems, R_xlen_t maxlines,
                       int flush, int fill, SEXP stripwhite, int blskip,
-                      int multiline, LocalData *d)
+                      int multiline, int threads, LocalData *d)
 {
     SEXP ans, new, old, w;
     char *buffer = NULL;
@@ -712,6 +1324,44 @@ static SEXP scanFrame(SEXP what, R_xlen_t maxitems, R_xlen_t maxlines,
     Rboolean vec_strip = (xlength(stripwhite) == xlength(what));
     strip = lstrip[0];
 
+    /* Can the records be read in blocks? */
+    ScanSpec spec;
+    Rboolean blocks = threads > 1 && !d->ttyflag && !d->escapes &&
+	maxitems <= 0 && maxlines <= 0 && !flush && (fill || !multiline) &&
+	!(MB_CUR_MAX == 2 && !d->isUTF8 && !d->isLatin1) &&
+	!(d->sepchar && (d->sepchar == d->comchar ||
+			 strchr(d->quoteset, d->sepchar)));
+    if (blocks) {
+	spec.nc = (int) nc;
+	spec.types = (SEXPTYPE *) R_alloc(nc, sizeof(SEXPTYPE));
+	spec.strip = vec_strip ? lstrip : NULL;
+	spec.strip1 = lstrip[0];
+	spec.fill = fill;
+	spec.blskip = blskip;
+	spec.nna = length(d->NAstrings);
+	spec.na = (const char **) R_alloc(spec.nna, sizeof(char *));
+	for (i = 0; i < spec.nna; i++)
+	    spec.na[i] = CHAR(STRING_ELT(d->NAstrings, i));
+	spec.quotes = FALSE;
+	for (i = 0; i < nc; i++) {
+	    spec.types[i] = TYPEOF(VECTOR_ELT(ans, i));
+	    switch (spec.types[i]) {
+	    case STRSXP:
+	    case NILSXP:
+		/* without a separator, a nul opens a quoted string */
+		if (d->quoteset[0] || (!d->sepchar && !d->skipNul))
+		    spec.quotes = TRUE;
+		/* fall through */
+	    case LGLSXP:
+	    case INTSXP:
+	    case REALSXP:
+		break;
+	    default:
+		blocks = FALSE;
+	    }
+	}
+    }
+
     for (;;) {
 	if(linesread % 1000 == 999) R_CheckUserInterrupt();
 
@@ -743,6 +1393,16 @@ static SEXP scanFrame(SEXP what, R_xlen_t maxitems, R_xlen_t maxlines,
 	    if (d->ttyflag)
 		snprintf(ConsolePrompt, CONSOLE_PROMPT_SIZE,
 		         "%lld: ", (long long) (n + 1));
+	    /* read.table() pushes back its first lines, so try at each
+	       line start until they have been read */
+	    if (blocks) {
+		R_xlen_t nb = scanBlocks(ans, &blksize, n, &linesread,
+					 threads, &spec, d);
+		if (nb >= 0) {
+		    n = nb;
+		    goto done;
+		}
+	    }
 	}
 	if (n == blksize && colsread == 0) {
 	    if(blksize > R_XLEN_T_MAX/2) error(_("too many items"));
@@ -836,7 +1496,7 @@ static SEXP scanFrame(SEXP what, R_xlen_t maxitems, R_xlen_t maxlines,
 SEXP attribute_hidden do_scan(SEXP call, SEXP op, SEXP args, SEXP rho)
 {
     SEXP ans, file, sep, what, stripwhite, dec, quotes, comstr;
-    int c, flush, fill, blskip, multiline, escapes, skipNul;
+    int c, flush, fill, blskip, multiline, escapes, skipNul, threads;
     R_xlen_t nmax, nlines, nskip;
     const char *p, *encoding;
     RCNTXT cntxt;
@@ -868,7 +1528,8 @@ SEXP attribute_hidden do_scan(SEXP call, SEXP op, SEXP args, SEXP rho)
     encoding = CHAR(STRING_ELT(CAR(args), 0)); args = CDR(args); /* ASCII */
     if(streql(encoding, "latin1")) data.isLatin1 = TRUE;
     if(streql(encoding, "UTF-8"))  data.isUTF8 = TRUE;
-    skipNul = asLogical(CAR(args));
+    skipNul = asLogical(CAR(args)); args = CDR(args);
+    threads = asInteger(CAR(args));
 
     if (data.quiet == NA_LOGICAL)		data.quiet = 0;
     if (blskip == NA_LOGICAL)			blskip = 1;
@@ -930,6 +1591,8 @@ SEXP attribute_hidden do_scan(SEXP call, SEXP op, SEXP args, SEXP rho)
     if(skipNul == NA_LOGICAL)
 	error(_("invalid '%s' argument"), "skipNul");
     data.skipNul = skipNul != 0;
+    if(threads == NA_INTEGER || threads < 1)
+	error(_("invalid '%s' argument"), "threads");
 
     int ii = asInteger(file);
     data.con = getConnection(ii);
@@ -980,7 +1643,7 @@ SEXP attribute_hidden do_scan(SEXP call, SEXP op, SEXP args, SEXP rho)
 
     case VECSXP:
 	ans = scanFrame(what, nmax, nlines, flush, fill, stripwhite,
-			blskip, multiline, &data);
+			blskip, multiline, threads, &data);
 	break;
     default:
 	error(_("invalid '%s' argument"), "what");
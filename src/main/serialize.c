@@ -31,6 +31,7 @@
 #include <Rversion.h>
 #include <R_ext/Riconv.h>
 #include <R_ext/RS.h>           /* for CallocCharBuf, Free */
+#include <Rconnections.h>
 #include <errno.h>
 #include <ctype.h>		/* for isspace */
 #include <stdarg.h>
@@ -178,6 +179,16 @@
    Version 3 also adds support for custom ALTREP serialization. Under
    version 2 ALTREP objects are serialied like non-ALTREP ones. */
 
+/* ----- V e r s i o n -- F o u r -- S a v e / R e s t o r e ----- */
+
+/* This format extends version 3 format by entering strings (other
+   than NA_STRING) of character vectors in the reference table: a
+   CHARSXP is written in full the first time it is seen, with the
+   otherwise unused HAS_TAG bit set in its flags to tell the reader to
+   add it to the table, and later as a REFSXP (see OutStringElt).  So
+   a character vector with many repeated values (as a factor-like
+   column) is written and read with one copy of each. */
+
 /*
  * Forward Declarations
  */
@@ -187,6 +198,8 @@ static void WriteItem (SEXP s, SEXP ref_table, R_outpstream_t stream);
 static SEXP ReadItem(SEXP ref_table, R_inpstream_t stream);
 static void WriteBC(SEXP s, SEXP ref_table, R_outpstream_t stream);
 static SEXP ReadBC(SEXP ref_table, R_inpstream_t stream);
+static void OutBytesConn(R_outpstream_t stream, void *buf, int length);
+static void InBytesConn(R_inpstream_t stream, void *buf, int length);
 
 /*
  * Constants
@@ -204,7 +217,7 @@ static int defaultSerializeVersion()
 	int val = -1;
 	if (valstr != NULL)
 	    val = atoi(valstr);
-	if (val == 2 || val == 3)
+	if (val >= 2 && val <= 4)
 	    dflt = val;
 	else
 	    dflt = 3; /* the default */
@@ -239,6 +252,11 @@ static int Rsnprintf(char *buf, int size, const char *format, ...)
     return val;
 }
 
+/* The aligned variant of the binary format (see OutFormat) is only
+   written by saveRDS(mmap = TRUE), so it is not one of the public
+   R_pstream_format_t values; switches which handle it are on an int. */
+#define R_pstream_aligned_format \
+    ((R_pstream_format_t) (R_pstream_asciihex_format + 1))
 
 /*
  * Basic Output Routines
@@ -247,7 +265,7 @@ static int Rsnprintf(char *buf, int size, const char *format, ...)
 static void OutInteger(R_outpstream_t stream, int i)
 {
     char buf[128];
-    switch (stream->type) {
+    switch ((int) stream->type) {
     case R_pstream_ascii_format:
     case R_pstream_asciihex_format:
 	if (i == NA_INTEGER)
@@ -257,6 +275,7 @@ static void OutInteger(R_outpstream_t stream, int i)
 	stream->OutBytes(stream, buf, (int)strlen(buf));
 	break;
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
 	stream->OutBytes(stream, &i, sizeof(int));
 	break;
     case R_pstream_xdr_format:
@@ -271,7 +290,7 @@ static void OutInteger(R_outpstream_t stream, int i)
 static void OutReal(R_outpstream_t stream, double d)
 {
     char buf[128];
-    switch (stream->type) {
+    switch ((int) stream->type) {
     case R_pstream_ascii_format:
 	if (! R_FINITE(d)) {
 	    if (ISNA(d))
@@ -304,6 +323,7 @@ static void OutReal(R_outpstream_t stream, double d)
 	stream->OutBytes(stream, buf, (int)strlen(buf));
 	break;
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
 	stream->OutBytes(stream, &d, sizeof(double));
 	break;
     case R_pstream_xdr_format:
@@ -324,13 +344,14 @@ static void OutComplex(R_outpstream_t stream, Rcomplex c)
 static void OutByte(R_outpstream_t stream, Rbyte i)
 {
     char buf[128];
-    switch (stream->type) {
+    switch ((int) stream->type) {
     case R_pstream_ascii_format:
     case R_pstream_asciihex_format:
 	Rsnprintf(buf, sizeof(buf), "%02x\n", i);
 	stream->OutBytes(stream, buf, (int)strlen(buf));
 	break;
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
     case R_pstream_xdr_format:
 	stream->OutBytes(stream, &i, 1);
 	break;
@@ -407,7 +428,7 @@ static int InInteger(R_inpstream_t stream)
     char buf[128];
     int i;
 
-    switch (stream->type) {
+    switch ((int) stream->type) {
     case R_pstream_ascii_format:
 	InWord(stream, word, sizeof(word));
 	if(sscanf(word, "%127s", buf) != 1) error(_("read error"));
@@ -417,6 +438,7 @@ static int InInteger(R_inpstream_t stream)
 	    if(sscanf(buf, "%d", &i) != 1) error(_("read error"));
 	return i;
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
 	stream->InBytes(stream, &i, sizeof(int));
 	return i;
     case R_pstream_xdr_format:
@@ -438,7 +460,7 @@ static double InReal(R_inpstream_t stream)
     char buf[128];
     double d;
 
-    switch (stream->type) {
+    switch ((int) stream->type) {
     case R_pstream_ascii_format:
 	InWord(stream, word, sizeof(word));
 	if(sscanf(word, "%127s", buf) != 1) error(_("read error"));
@@ -460,6 +482,7 @@ static double InReal(R_inpstream_t stream)
 		!= 1) error(_("read error"));
 	return d;
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
 	stream->InBytes(stream, &d, sizeof(double));
 	return d;
     case R_pstream_xdr_format:
@@ -561,8 +584,15 @@ static void InString(R_inpstream_t stream, char *buf, int length)
 /*
  * Format Header Reading and Writing
  *
- * The header starts with one of three characters, A for ascii, B for
- * binary, or X for xdr.
+ * The header starts with one of four characters, A for ascii, B for
+ * binary, X for xdr or M for aligned binary.
+ *
+ * The aligned format is the native binary format in which the
+ * contents of logical, integer and double vectors are preceded by an
+ * integer count of padding bytes and the padding.  When writing a
+ * large vector to a file, the padding makes its contents start at a
+ * multiple of R_SER_ALIGNMENT bytes into the file, so that they can be
+ * memory-mapped when read back.
  */
 
 static void OutFormat(R_outpstream_t stream)
@@ -571,13 +601,14 @@ static void OutFormat(R_outpstream_t stream)
 	warning(_("binary format is deprecated; using xdr instead"));
 	stream->type = R_pstream_xdr_format;
 	} */
-    switch (stream->type) {
+    switch ((int) stream->type) {
     case R_pstream_ascii_format:
     case R_pstream_asciihex_format:
 	stream->OutBytes(stream, "A\n", 2); break;
 	/* on deserialization, asciihex_format is treated exactly the same
 	   way as ascii_format; the distinction is handled inside scanf %lg */
     case R_pstream_binary_format: stream->OutBytes(stream, "B\n", 2); break;
+    case R_pstream_aligned_format: stream->OutBytes(stream, "M\n", 2); break;
     case R_pstream_xdr_format:    stream->OutBytes(stream, "X\n", 2); break;
     case R_pstream_any_format:
 	error(_("must specify ascii, binary, or xdr format"));
@@ -593,6 +624,7 @@ static void InFormat(R_inpstream_t stream)
     switch (buf[0]) {
     case 'A': type = R_pstream_ascii_format; break; /* also for asciihex */
     case 'B': type = R_pstream_binary_format; break;
+    case 'M': type = R_pstream_aligned_format; break;
     case 'X': type = R_pstream_xdr_format; break;
     case '\n':
 	/* GROSS HACK: ASCII unserialize may leave a trailing newline
@@ -628,13 +660,14 @@ static void InFormat(R_inpstream_t stream)
  * Objects are entered, and the order in which they are encountered is
  * recorded.  GashGet returns this number, a positive integer, if the
  * object was seen before, and zero if not.  A fixed hash table size
- * is used; this is not ideal but seems adequate for now.  The hash
- * table representation consists of a (R_NilValue . vector) pair.  The
- * hash buckets are in the vector.  This indirect representation
- * should allow resizing the table at some point.
+ * is used to start with, and doubled when the chains get long (as
+ * they will with many strings in version 4).  The hash table
+ * representation consists of a (R_NilValue . vector) pair.  The hash
+ * buckets are in the vector, which is replaced when resizing.
  */
 
 #define HASHSIZE 1099
+#define HASH_MAX_LOAD 4 /* the average chain length before growing */
 
 #define PTRHASH(obj) (((R_size_t) (obj)) >> 2)
 
@@ -653,10 +686,33 @@ static SEXP MakeHashTable(void)
     return val;
 }
 
+static void HashResize(SEXP ht)
+{
+    SEXP table = CDR(ht);
+    int size = LENGTH(table), newsize = 2 * size + 1;
+    SEXP newtable = allocVector(VECSXP, newsize);
+
+    for (int i = 0; i < size; i++) {
+	SEXP cell = VECTOR_ELT(table, i);
+	while (cell != R_NilValue) {
+	    SEXP next = CDR(cell);
+	    R_size_t pos = PTRHASH(TAG(cell)) % newsize;
+	    SETCDR(cell, VECTOR_ELT(newtable, pos));
+	    SET_VECTOR_ELT(newtable, pos, cell);
+	    cell = next;
+	}
+    }
+    SET_TRUELENGTH(newtable, TRUELENGTH(table));
+    SETCDR(ht, newtable);
+}
+
 static void HashAdd(SEXP obj, SEXP ht)
 {
-    R_size_t pos = PTRHASH(obj) % HASH_TABLE_SIZE(ht);
     int count = HASH_TABLE_COUNT(ht) + 1;
+    if (count > HASH_MAX_LOAD * HASH_TABLE_SIZE(ht)
+	&& HASH_TABLE_SIZE(ht) < INT_MAX / 4)
+	HashResize(ht);
+    R_size_t pos = PTRHASH(obj) % HASH_TABLE_SIZE(ht);
     SEXP val = ScalarInteger(count);
     SEXP cell = CONS(val, HASH_BUCKET(ht, pos));
 
@@ -865,6 +921,25 @@ static void WriteLENGTH(R_outpstream_t stream, SEXP s)
 #endif
 }
 
+/* Version 4: an element of a character vector is written in full the
+   first time, flagged by HAS_TAG for the reader to enter it in the
+   reference table as the writer does, and then as a reference */
+static void OutStringElt(R_outpstream_t stream, SEXP s, SEXP ref_table)
+{
+    int i;
+
+    if (s == NA_STRING)
+	WriteItem(s, ref_table, stream);
+    else if ((i = HashGet(s, ref_table)) != 0)
+	OutRefIndex(stream, i);
+    else {
+	HashAdd(s, ref_table);
+	OutInteger(stream, PackFlags(CHARSXP, LEVELS(s), 0, 0, 1));
+	OutInteger(stream, LENGTH(s));
+	OutString(stream, CHAR(s), LENGTH(s));
+    }
+}
+
 static void OutStringVec(R_outpstream_t stream, SEXP s, SEXP ref_table)
 {
     R_assert(TYPEOF(s) == STRSXP);
@@ -893,7 +968,7 @@ static void OutStringVec(R_outpstream_t stream, SEXP s, SEXP ref_table)
 static R_INLINE void
 OutIntegerVec(R_outpstream_t stream, SEXP s, R_xlen_t length)
 {
-    switch (stream->type) {
+    switch ((int) stream->type) {
     case R_pstream_xdr_format:
     {
 	static char buf[CHUNK_SIZE * sizeof(int)];
@@ -911,6 +986,7 @@ OutIntegerVec(R_outpstream_t stream, SEXP s, R_xlen_t length)
 	break;
     }
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
     {
 	/* write in chunks to avoid overflowing ints */
 	R_xlen_t done, this;
@@ -930,7 +1006,7 @@ OutIntegerVec(R_outpstream_t stream, SEXP s, R_xlen_t length)
 static R_INLINE void
 OutRealVec(R_outpstream_t stream, SEXP s, R_xlen_t length)
 {
-    switch (stream->type) {
+    switch ((int) stream->type) {
     case R_pstream_xdr_format:
     {
 	static char buf[CHUNK_SIZE * sizeof(double)];
@@ -948,6 +1024,7 @@ OutRealVec(R_outpstream_t stream, SEXP s, R_xlen_t length)
 	break;
     }
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
     {
 	R_xlen_t done, this;
 	for (done = 0; done < length; done += this) {
@@ -966,7 +1043,7 @@ OutRealVec(R_outpstream_t stream, SEXP s, R_xlen_t length)
 static R_INLINE void
 OutComplexVec(R_outpstream_t stream, SEXP s, R_xlen_t length)
 {
-    switch (stream->type) {
+    switch ((int) stream->type) {
     case R_pstream_xdr_format:
     {
 	static char buf[CHUNK_SIZE * sizeof(Rcomplex)];
@@ -987,6 +1064,7 @@ OutComplexVec(R_outpstream_t stream, SEXP s, R_xlen_t length)
 	break;
     }
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
     {
 	R_xlen_t done, this;
 	for (done = 0; done < length; done += this) {
@@ -1002,6 +1080,37 @@ OutComplexVec(R_outpstream_t stream, SEXP s, R_xlen_t length)
     }
 }
 
+/* Alignment of the contents of large vectors in the aligned format:
+   this is a multiple of the page sizes in common use. */
+#define R_SER_ALIGNMENT 65536
+/* Vectors with fewer bytes than this are not padded */
+#define R_SER_ALIGNED_MIN (16 * R_SER_ALIGNMENT)
+
+/* For the aligned format: write the padding which precedes the
+   contents of a vector of 'nbytes' bytes.  Only streams writing to a
+   file connection know their position, so elsewhere the padding is
+   empty. */
+static void OutPadding(R_outpstream_t stream, double nbytes)
+{
+    static char zeros[CHUNK_SIZE];
+    int npad = 0;
+
+    if (nbytes >= R_SER_ALIGNED_MIN && stream->OutBytes == OutBytesConn) {
+	Rconnection con = (Rconnection) stream->data;
+	if (con->canseek && streql(con->class, "file")) {
+	    /* position after the padding count */
+	    double pos = con->seek(con, NA_REAL, 1, 2) + sizeof(int);
+	    int rem = (int) fmod(pos, R_SER_ALIGNMENT);
+	    if (pos > 0 && rem) npad = R_SER_ALIGNMENT - rem;
+	}
+    }
+    OutInteger(stream, npad);
+    for (int left = npad, this; left > 0; left -= this) {
+	this = min2(CHUNK_SIZE, left);
+	stream->OutBytes(stream, zeros, this);
+    }
+}
+
 static void WriteItem (SEXP s, SEXP ref_table, R_outpstream_t stream)
 {
     int i;
@@ -1158,11 +1267,15 @@ static void WriteItem (SEXP s, SEXP ref_table, R_outpstream_t stream)
 	case INTSXP:
 	    len = XLENGTH(s);
 	    WriteLENGTH(stream, s);
+	    if (stream->type == R_pstream_aligned_format)
+		OutPadding(stream, (double) len * sizeof(int));
 	    OutIntegerVec(stream, s, len);
 	    break;
 	case REALSXP:
 	    len = XLENGTH(s);
 	    WriteLENGTH(stream, s);
+	    if (stream->type == R_pstream_aligned_format)
+		OutPadding(stream, (double) len * sizeof(double));
 	    OutRealVec(stream, s, len);
 	    break;
 	case CPLXSXP:
@@ -1173,8 +1286,12 @@ static void WriteItem (SEXP s, SEXP ref_table, R_outpstream_t stream)
 	case STRSXP:
 	    len = XLENGTH(s);
 	    WriteLENGTH(stream, s);
-	    for (R_xlen_t ix = 0; ix < len; ix++)
-		WriteItem(STRING_ELT(s, ix), ref_table, stream);
+	    if (stream->version >= 4)
+		for (R_xlen_t ix = 0; ix < len; ix++)
+		    OutStringElt(stream, STRING_ELT(s, ix), ref_table);
+	    else
+		for (R_xlen_t ix = 0; ix < len; ix++)
+		    WriteItem(STRING_ELT(s, ix), ref_table, stream);
 	    break;
 	case VECSXP:
 	case EXPRSXP:
@@ -1189,9 +1306,10 @@ static void WriteItem (SEXP s, SEXP ref_table, R_outpstream_t stream)
 	case RAWSXP:
 	    len = XLENGTH(s);
 	    WriteLENGTH(stream, s);
-	    switch (stream->type) {
+	    switch ((int) stream->type) {
 	    case R_pstream_xdr_format:
 	    case R_pstream_binary_format:
+	    case R_pstream_aligned_format:
 	    {
 		R_xlen_t done, this;
 		for (done = 0; done < len; done += this) {
@@ -1385,10 +1503,11 @@ void R_Serialize(SEXP s, R_outpstream_t stream)
 	OutInteger(stream, R_Version(2,3,0));
 	break;
     case 3:
+    case 4:
     {
 	OutInteger(stream, version);
 	OutInteger(stream, R_VERSION);
-	OutInteger(stream, R_Version(3,5,0));
+	OutInteger(stream, version == 3 ? R_Version(3,5,0) : R_Version(4,1,0));
 	const char *natenc = R_nativeEncoding();
 	int nelen = (int) strlen(natenc);
 	OutInteger(stream, nelen);
@@ -1473,7 +1592,7 @@ static SEXP InStringVec(R_inpstream_t stream, SEXP ref_table)
 static R_INLINE void
 InIntegerVec(R_inpstream_t stream, SEXP obj, R_xlen_t length)
 {
-    switch (stream->type) {
+    switch ((int) stream->type) {
     case R_pstream_xdr_format:
     {
 	static char buf[CHUNK_SIZE * sizeof(int)];
@@ -1491,6 +1610,7 @@ InIntegerVec(R_inpstream_t stream, SEXP obj, R_xlen_t length)
 	break;
     }
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
     {
 	R_xlen_t done, this;
 	for (done = 0; done < length; done += this) {
@@ -1509,7 +1629,7 @@ InIntegerVec(R_inpstream_t stream, SEXP obj, R_xlen_t length)
 static R_INLINE void
 InRealVec(R_inpstream_t stream, SEXP obj, R_xlen_t length)
 {
-    switch (stream->type) {
+    switch ((int) stream->type) {
     case R_pstream_xdr_format:
     {
 	static char buf[CHUNK_SIZE * sizeof(double)];
@@ -1527,6 +1647,7 @@ InRealVec(R_inpstream_t stream, SEXP obj, R_xlen_t length)
 	break;
     }
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
     {
 	R_xlen_t done, this;
 	for (done = 0; done < length; done += this) {
@@ -1545,7 +1666,7 @@ InRealVec(R_inpstream_t stream, SEXP obj, R_xlen_t length)
 static R_INLINE void
 InComplexVec(R_inpstream_t stream, SEXP obj, R_xlen_t length)
 {
-    switch (stream->type) {
+    switch ((int) stream->type) {
     case R_pstream_xdr_format:
     {
 	static char buf[CHUNK_SIZE * sizeof(Rcomplex)];
@@ -1566,6 +1687,7 @@ InComplexVec(R_inpstream_t stream, SEXP obj, R_xlen_t length)
 	break;
     }
     case R_pstream_binary_format:
+    case R_pstream_aligned_format:
     {
 	R_xlen_t done, this;
 	for (done = 0; done < length; done += this) {
@@ -1749,6 +1871,41 @@ static SEXP R_FindNamespace1(SEXP info)
 }
 
 
+/* The file connection being unserialized by readRDS(mmap = TRUE) */
+static Rconnection mmap_con = NULL;
+
+/* For the aligned format: read the padding before the contents of a
+   vector, and if they can be memory-mapped do so and return the
+   vector, skipping its contents.  Otherwise return NULL with the
+   stream positioned at the contents. */
+static SEXP InAlignedVec(R_inpstream_t stream, SEXPTYPE type, R_xlen_t len)
+{
+    int npad = InInteger(stream);
+    size_t size = (type == REALSXP) ? sizeof(double) : sizeof(int);
+
+    if (npad < 0 || npad >= R_SER_ALIGNMENT)
+	error(_("invalid padding in aligned format"));
+    if (type != LGLSXP && mmap_con != NULL &&
+	stream->InBytes == InBytesConn && stream->data == mmap_con &&
+	(double) len * size >= R_SER_ALIGNED_MIN) {
+	Rconnection con = mmap_con;
+	double offset = con->seek(con, NA_REAL, 1, 1) + npad;
+	SEXP file = PROTECT(mkString(con->description));
+	SEXP val = R_mmap_file_region(file, type, offset, len);
+	UNPROTECT(1);
+	if (val != NULL) {
+	    con->seek(con, offset + (double) len * size, 1, 1);
+	    return val;
+	}
+    }
+    char buf[CHUNK_SIZE];
+    for (int left = npad, this; left > 0; left -= this) {
+	this = min2(CHUNK_SIZE, left);
+	stream->InBytes(stream, buf, this);
+    }
+    return NULL;
+}
+
 static SEXP ReadItem (SEXP ref_table, R_inpstream_t stream)
 {
     SEXPTYPE type;
@@ -1923,15 +2080,27 @@ static SEXP ReadItem (SEXP ref_table, R_inpstream_t stream)
 		PROTECT(s = ReadChar(stream, cbuf, length, levs));
 		Free(cbuf);
 	    }
+	    if (hastag) /* version 4 */
+		AddReadRef(ref_table, s);
 	    break;
 	case LGLSXP:
 	case INTSXP:
 	    len = ReadLENGTH(stream);
+	    if (stream->type == R_pstream_aligned_format &&
+		(s = InAlignedVec(stream, type, len)) != NULL) {
+		PROTECT(s);
+		break;
+	    }
 	    PROTECT(s = allocVector(type, len));
 	    InIntegerVec(stream, s, len);
 	    break;
 	case REALSXP:
 	    len = ReadLENGTH(stream);
+	    if (stream->type == R_pstream_aligned_format &&
+		(s = InAlignedVec(stream, type, len)) != NULL) {
+		PROTECT(s);
+		break;
+	    }
 	    PROTECT(s = allocVector(type, len));
 	    InRealVec(stream, s, len);
 	    break;
@@ -2151,6 +2320,7 @@ SEXP R_Unserialize(R_inpstream_t stream)
     switch (version) {
     case 2: break;
     case 3:
+    case 4:
     {
 	int nelen = InInteger(stream);
 	if (nelen > R_CODESET_MAX)
@@ -2178,7 +2348,7 @@ SEXP R_Unserialize(R_inpstream_t stream)
     PROTECT(ref_table = MakeReadRefTable());
     obj =  ReadItem(ref_table, stream);
 
-    if (version == 3) {
+    if (version >= 3) {
 	if (stream->nat2nat_obj && stream->nat2nat_obj != (void *)-1) {
 	    Riconv_close(stream->nat2nat_obj);
 	    stream->nat2nat_obj = NULL;
@@ -2205,7 +2375,7 @@ SEXP R_SerializeInfo(R_inpstream_t stream)
 
     /* Read the version numbers */
     version = InInteger(stream);
-    if (version == 3)
+    if (version >= 3)
 	anslen++;
     writer_version = InInteger(stream);
     min_reader_version = InInteger(stream);
@@ -2228,20 +2398,23 @@ SEXP R_SerializeInfo(R_inpstream_t stream)
 	SET_VECTOR_ELT(ans, 2, mkString(buf));
     }
     SET_STRING_ELT(names, 3, mkChar("format"));
-    switch(stream->type) {
+    switch((int) stream->type) {
     case R_pstream_ascii_format:
 	SET_VECTOR_ELT(ans, 3, mkString("ascii"));
 	break;
     case R_pstream_binary_format:
 	SET_VECTOR_ELT(ans, 3, mkString("binary"));
 	break;
+    case R_pstream_aligned_format:
+	SET_VECTOR_ELT(ans, 3, mkString("aligned"));
+	break;
     case R_pstream_xdr_format:
 	SET_VECTOR_ELT(ans, 3, mkString("xdr"));
 	break;
     default:
 	error(_("unknown input format"));
     }
-    if (version == 3) {
+    if (version >= 3) {
 	SET_STRING_ELT(names, 4, mkChar("native_encoding"));
 	int nelen = InInteger(stream);
 	if (nelen > R_CODESET_MAX)
@@ -2350,8 +2523,6 @@ R_InitFileInPStream(R_inpstream_t stream, FILE *fp,
  * Persistent Connection Streams
  */
 
-#include <Rconnections.h>
-
 static void CheckInConn(Rconnection con)
 {
     if (! con->isopen)
@@ -2492,7 +2663,7 @@ static void con_cleanup(void *data)
 SEXP attribute_hidden
 do_serializeToConn(SEXP call, SEXP op, SEXP args, SEXP env)
 {
-    /* serializeToConn(object, conn, ascii, version, hook) */
+    /* serializeToConn(object, conn, ascii, version, hook, aligned) */
 
     SEXP object, fun;
     Rboolean ascii, wasopen;
@@ -2513,6 +2684,8 @@ do_serializeToConn(SEXP call, SEXP op, SEXP args, SEXP env)
     ascii = INTEGER(CADDR(args))[0];
     if (ascii == NA_LOGICAL) type = R_pstream_asciihex_format;
     else if (ascii) type = R_pstream_ascii_format;
+    else if (asLogical(CAR(nthcdr(args, 5))) == TRUE)
+	type = R_pstream_aligned_format;
     else type = R_pstream_xdr_format;
 
     if (CADDDR(args) == R_NilValue)
@@ -2556,25 +2729,37 @@ do_serializeToConn(SEXP call, SEXP op, SEXP args, SEXP env)
     return R_NilValue;
 }
 
-/* unserializeFromConn(conn, hook) used from readRDS().
+static void mmap_con_cleanup(void *data)
+{
+    mmap_con = (Rconnection) data;
+}
+
+/* unserializeFromConn(conn, hook, mmap) used from readRDS().
    It became public in R 2.13.0, and that version added support for
    connections internally */
 SEXP attribute_hidden
 do_unserializeFromConn(SEXP call, SEXP op, SEXP args, SEXP env)
 {
-    /* 0 .. unserializeFromConn(conn, hook) */
+    /* 0 .. unserializeFromConn(conn, hook, mmap) */
     /* 1 .. serializeInfoFromConn(conn) */
 
     struct R_inpstream_st in;
-    Rconnection con;
+    Rconnection con, omcon = mmap_con;
     SEXP fun, ans;
     SEXP (*hook)(SEXP, SEXP);
-    Rboolean wasopen;
+    Rboolean wasopen, mmap = FALSE;
     RCNTXT cntxt;
 
     checkArity(op, args);
 
     con = getConnection(asInteger(CAR(args)));
+    if (PRIMVAL(op) == 0) {
+	mmap = asLogical(CADDR(args));
+	if (mmap == NA_LOGICAL)
+	    error(_("invalid '%s' argument"), "mmap");
+	/* only uncompressed files can be mapped */
+	if (mmap && !streql(con->class, "file")) mmap = FALSE;
+    }
 
     /* Now we need to do some sanity checking of the arguments.
        A filename will already have been opened, so anything
@@ -2598,7 +2783,19 @@ do_unserializeFromConn(SEXP call, SEXP op, SEXP args, SEXP env)
     fun = PRIMVAL(op) == 0 ? CADR(args) : R_NilValue;
     hook = fun != R_NilValue ? CallHook : NULL;
     R_InitConnInPStream(&in, con, R_pstream_any_format, hook, fun);
-    ans = PRIMVAL(op) == 0 ? R_Unserialize(&in) : R_SerializeInfo(&in);    
+    if (mmap) {
+	/* Set up a context which will reset mmap_con on error */
+	RCNTXT mcntxt;
+	begincontext(&mcntxt, CTXT_CCODE, R_NilValue, R_BaseEnv, R_BaseEnv,
+		     R_NilValue, R_NilValue);
+	mcntxt.cend = &mmap_con_cleanup;
+	mcntxt.cenddata = omcon;
+	mmap_con = con;
+	ans = R_Unserialize(&in);
+	endcontext(&mcntxt);
+	mmap_con = omcon;
+    } else
+	ans = PRIMVAL(op) == 0 ? R_Unserialize(&in) : R_SerializeInfo(&in);
     if(!wasopen) {
 	PROTECT(ans); /* paranoia about next line */
 	endcontext(&cntxt);
@@ -2949,12 +3146,42 @@ static SEXP appendRawToFile(SEXP file, SEXP bytes)
     return val;
 }
 
-/* Interface to cache the pkg.rdb files */
+/* Interface to cache the pkg.rdb files.
+
+   A database is cached whole on first use: memory-mapped where the
+   platform allows (when there is no limit on its size, and pages are
+   only read as the objects in them are fetched), else read into
+   memory if smaller than LEN_LIMIT.  As a mapped file might be
+   rewritten in place (e.g. by re-installing a package) and accessing
+   a mapping beyond the end of a truncated file is fatal, its size is
+   checked at each fetch and the file mapped again if it has changed. */
+
+#ifndef Win32
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# define LAZYLOAD_MMAP
+#endif
 
 #define NC 100
 static int used = 0;
 static char names[NC][PATH_MAX];
 static char *ptr[NC];
+static size_t sizes[NC];
+static Rboolean mapped[NC];
+
+static void freeCachedFile(int i)
+{
+#ifdef LAZYLOAD_MMAP
+    if (mapped[i]) {
+	if (sizes[i]) munmap(ptr[i], sizes[i]);
+    } else
+#endif
+	free(ptr[i]);
+    ptr[i] = NULL;
+    mapped[i] = FALSE;
+}
 
 SEXP attribute_hidden
 do_lazyLoadDBflush(SEXP call, SEXP op, SEXP args, SEXP env)
@@ -2968,7 +3195,7 @@ do_lazyLoadDBflush(SEXP call, SEXP op, SEXP args, SEXP env)
     for (i = 0; i < used; i++)
 	if(strcmp(cfile, names[i]) == 0) {
 	    strcpy(names[i], "");
-	    free(ptr[i]);
+	    freeCachedFile(i);
 	    /* fprintf(stderr, " found at pos %d in cache", i); */
 	    break;
 	}
@@ -2976,6 +3203,39 @@ do_lazyLoadDBflush(SEXP call, SEXP op, SEXP args, SEXP env)
     return R_NilValue;
 }
 
+#ifdef LAZYLOAD_MMAP
+/* Map the whole of a regular file into cache slot i, returning FALSE
+   if that fails */
+static Rboolean mapFile(const char *cfile, int i)
+{
+    struct stat sb;
+    void *p;
+    int fd = open(cfile, O_RDONLY);
+
+    if (fd == -1) return FALSE;
+    if (fstat(fd, &sb) != 0 || !S_ISREG(sb.st_mode) || sb.st_size == 0 ||
+	(double) sb.st_size > (double) SIZE_MAX) {
+	close(fd);
+	return FALSE;
+    }
+    p = mmap(0, (size_t) sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return FALSE;
+    strcpy(names[i], cfile);
+    ptr[i] = (char *) p;
+    sizes[i] = (size_t) sb.st_size;
+    mapped[i] = TRUE;
+    return TRUE;
+}
+
+/* Is the mapping in cache slot i still that of the file? */
+static Rboolean mappingValid(int i)
+{
+    struct stat sb;
+    return stat(names[i], &sb) == 0 && (size_t) sb.st_size == sizes[i];
+}
+#endif
+
 
 /* Reads, in binary mode, the bytes in the range specified by a
    position/length vector and returns them as raw vector. */
@@ -2997,12 +3257,25 @@ static SEXP readRawFromFile(SEXP file, SEXP key)
 
     offset = INTEGER(key)[0];
     len = INTEGER(key)[1];
+    if (offset < 0 || len < 0)
+	error(_("bad offset/length argument"));
 
     val = allocVector(RAWSXP, len);
     /* Do we have this database cached? */
     for (i = 0; i < used; i++)
 	if(strcmp(cfile, names[i]) == 0) {icache = i; break;}
+#ifdef LAZYLOAD_MMAP
+    if (icache >= 0 && mapped[icache] && !mappingValid(icache)) {
+	freeCachedFile(icache);
+	if (!mapFile(cfile, icache)) {
+	    strcpy(names[icache], "");
+	    icache = -1;
+	}
+    }
+#endif
     if (icache >= 0) {
+	if ((size_t) offset + len > sizes[icache])
+	    error(_("lazy-load database '%s' is corrupt"), cfile);
 	memcpy(RAW(val), ptr[icache]+offset, len);
 	return val;
     }
@@ -3012,6 +3285,15 @@ static SEXP readRawFromFile(SEXP file, SEXP key)
 	if(strcmp("", names[i]) == 0) {icache = i; break;}
     if(icache < 0 && used < NC) icache = used++;
 
+#ifdef LAZYLOAD_MMAP
+    if(icache >= 0 && mapFile(cfile, icache)) {
+	if ((size_t) offset + len > sizes[icache])
+	    error(_("lazy-load database '%s' is corrupt"), cfile);
+	memcpy(RAW(val), ptr[icache]+offset, len);
+	return val;
+    }
+#endif
+
     if(icache >= 0) {
 	if ((fp = R_fopen(cfile, "rb")) == NULL)
 	    error(_("cannot open file '%s': %s"), cfile, strerror(errno));
@@ -3028,6 +3310,8 @@ static SEXP readRawFromFile(SEXP file, SEXP key)
 	    if (p) {
 		strcpy(names[icache], cfile);
 		ptr[icache] = p;
+		sizes[icache] = filelen;
+		mapped[icache] = FALSE;
 		if (fseek(fp, 0, SEEK_SET) != 0) {
 		    fclose(fp);
 		    error(_("seek failed on %s"), cfile);
@@ -3035,6 +3319,8 @@ static SEXP readRawFromFile(SEXP file, SEXP key)
 		in = (int) fread(p, 1, filelen, fp);
 		fclose(fp);
 		if (filelen != in) error(_("read failed on %s"), cfile);
+		if ((size_t) offset + len > sizes[icache])
+		    error(_("lazy-load database '%s' is corrupt"), cfile);
 		memcpy(RAW(val), p+offset, len);
 	    } else {
 		if (fseek(fp, offset, SEEK_SET) != 0) {
@@ -3123,6 +3409,8 @@ SEXP R_compress2(SEXP in);
 SEXP R_decompress2(SEXP in, Rboolean *err);
 SEXP R_compress3(SEXP in);
 SEXP R_decompress3(SEXP in, Rboolean *err);
+SEXP R_compress4(SEXP in);
+SEXP R_decompress4(SEXP in, Rboolean *err);
 
 /* Serializes and, optionally, compresses a value and appends the
    result to a file.  Returns the key position/length key for
@@ -3138,7 +3426,9 @@ R_lazyLoadDBinsertValue(SEXP value, SEXP file, SEXP ascii,
 
     value = R_serialize(value, R_NilValue, ascii, R_NilValue, hook);
     PROTECT_WITH_INDEX(value, &vpi);
-    if (compress == 3)
+    if (compress == 4)
+	REPROTECT(value = R_compress4(value), vpi);
+    else if (compress == 3)
 	REPROTECT(value = R_compress3(value), vpi);
     else if (compress == 2)
 	REPROTECT(value = R_compress2(value), vpi);
@@ -3170,7 +3460,9 @@ do_lazyLoadDBfetch(SEXP call, SEXP op, SEXP args, SEXP env)
     compressed = asInteger(compsxp);
 
     PROTECT_WITH_INDEX(val = readRawFromFile(file, key), &vpi);
-    if (compressed == 3)
+    if (compressed == 4)
+	REPROTECT(val = R_decompress4(val, &err), vpi);
+    else if (compressed == 3)
 	REPROTECT(val = R_decompress3(val, &err), vpi);
     else if (compressed == 2)
 	REPROTECT(val = R_decompress2(val, &err), vpi);
@@ -858,7 +858,82 @@ static R_INLINE nttype_t needsTranslation(SEXP x) {
 }
 
 static void *latin1_obj = NULL, *utf8_obj=NULL, *ucsmb_obj=NULL,
-    *ucsutf8_obj=NULL;
+    *ucsutf8_obj=NULL, *latin1utf8_obj = NULL, *nativeutf8_obj = NULL;
+
+/* A cache of recent translations of CHARSXPs by translateChar() and
+   translateCharUTF8(), so that translating the same strings again (as
+   grepl(), nchar() or match() in a loop do) needs a copy rather than
+   a conversion by iconv.  It is direct-mapped on the address of the
+   CHARSXP, and holds malloc-ed copies of the translations.
+
+   The entries are weak references: the GC drops those whose CHARSXP
+   has become unreachable (see R_SweepTranslationCache), so an address
+   cannot be reused by another string while cached, and changing the
+   locale empties the cache along with the cached iconv objects.
+   Results are still returned in R_alloc-ed memory, as an entry can be
+   replaced while the caller is using its result. */
+#define TR_CACHE_SIZE 16384 /* a power of 2 */
+#define TR_CACHE_MAXLEN 256 /* longer translations are not cached */
+
+typedef struct {
+    SEXP x;        /* the CHARSXP translated, or NULL */
+    int utf8;      /* translated to UTF-8 rather than native */
+    size_t len;    /* including the terminator */
+    char *s;
+} trcache_t;
+
+static trcache_t trcache[TR_CACHE_SIZE];
+
+static R_INLINE trcache_t *trcache_slot(SEXP x, int utf8)
+{
+    /* nodes are at least 8-byte aligned and allocated in pages */
+    uintptr_t h = (uintptr_t) x >> 3;
+    h ^= h >> 10;
+    return trcache + (((h << 1) | utf8) & (TR_CACHE_SIZE - 1));
+}
+
+static const char *trcache_get(SEXP x, int utf8)
+{
+    trcache_t *e = trcache_slot(x, utf8);
+    if (e->x != x || e->utf8 != utf8) return NULL;
+    char *p = R_alloc(e->len, 1);
+    memcpy(p, e->s, e->len);
+    return p;
+}
+
+static void trcache_put(SEXP x, int utf8, const char *s, size_t len)
+{
+    trcache_t *e = trcache_slot(x, utf8);
+    if (len > TR_CACHE_MAXLEN) return;
+    char *p = realloc(e->s, len);
+    if (p == NULL) return; /* e->s is unchanged, so keep the entry */
+    memcpy(p, s, len);
+    e->x = x;
+    e->utf8 = utf8;
+    e->len = len;
+    e->s = p;
+}
+
+static void trcache_flush(void)
+{
+    for (int i = 0; i < TR_CACHE_SIZE; i++) {
+	free(trcache[i].s);
+	trcache[i].s = NULL;
+	trcache[i].x = NULL;
+    }
+}
+
+/* Called by the GC after marking, with live() testing whether a node
+   has been marked. */
+void attribute_hidden R_SweepTranslationCache(Rboolean (*live)(SEXP))
+{
+    for (int i = 0; i < TR_CACHE_SIZE; i++)
+	if (trcache[i].x != NULL && !live(trcache[i].x)) {
+	    free(trcache[i].s);
+	    trcache[i].s = NULL;
+	    trcache[i].x = NULL;
+	}
+}
 
 /* Translates string in "ans" to native encoding returning it in string
    buffer "cbuff" */
@@ -987,13 +1062,15 @@ const char *translateChar(SEXP x)
     nttype_t t = needsTranslation(x);
     const char *ans = CHAR(x);
     if (t == NT_NONE) return ans;
+    if ((ans = trcache_get(x, 0)) != NULL) return ans;
 
     R_StringBuffer cbuff = {NULL, 0, MAXELTSIZE};
-    translateToNative(ans, &cbuff, t, 0);
+    translateToNative(CHAR(x), &cbuff, t, 0);
 
     size_t res = strlen(cbuff.data) + 1;
     char *p = R_alloc(res, 1);
     memcpy(p, cbuff.data, res);
+    trcache_put(x, 0, p, res);
     R_FreeStringBuffer(&cbuff);
     return p;
 }
@@ -1098,22 +1175,28 @@ const char *translateCharUTF8(SEXP x)
     if(IS_ASCII(x)) return ans;
     if(IS_BYTES(x))
 	error(_("translating strings with \"bytes\" encoding is not allowed"));
+    if ((p = (char *) trcache_get(x, 1)) != NULL) return p;
 
-    if (IS_LATIN1(x))
+    void **pobj = IS_LATIN1(x) ? &latin1utf8_obj : &nativeutf8_obj;
+    if (*pobj == NULL) {
+	if (IS_LATIN1(x))
 #ifdef HAVE_ICONV_CP1252
-	from = "CP1252";
+	    from = "CP1252";
 #else
-	from = "latin1";
+	    from = "latin1";
 #endif
-    obj = Riconv_open("UTF-8", from);
-    if(obj == (void *)(-1))
+	obj = Riconv_open("UTF-8", from);
+	if(obj == (void *)(-1))
 #ifdef Win32
-	error(_("unsupported conversion from '%s' in codepage %d"),
-	      from, localeCP);
+	    error(_("unsupported conversion from '%s' in codepage %d"),
+		  from, localeCP);
 #else
-	error(_("unsupported conversion from '%s' to '%s'"),
-	      from, "UTF-8");
+	    error(_("unsupported conversion from '%s' to '%s'"),
+		  from, "UTF-8");
 #endif
+	*pobj = obj;
+    }
+    obj = *pobj;
     R_AllocStringBuffer(0, &cbuff);
 top_of_loop:
     inbuf = ans; inb = strlen(inbuf);
@@ -1137,10 +1220,10 @@ next_char:
 	goto next_char;
     }
     *outbuf = '\0';
-    Riconv_close(obj);
     res = strlen(cbuff.data) + 1;
     p = R_alloc(res, 1);
     memcpy(p, cbuff.data, res);
+    trcache_put(x, 1, p, res);
     R_FreeStringBuffer(&cbuff);
     return p;
 }
@@ -1566,6 +1649,15 @@ invalidate_cached_recodings(void)
 	Riconv_close(ucsmb_obj);
 	ucsmb_obj = NULL;
     }
+    if (latin1utf8_obj) {
+	Riconv_close(latin1utf8_obj);
+	latin1utf8_obj = NULL;
+    }
+    if (nativeutf8_obj) {
+	Riconv_close(nativeutf8_obj);
+	nativeutf8_obj = NULL;
+    }
+    trcache_flush();
 #ifdef Win32
     if (latin1_wobj) {
 	Riconv_close(latin1_wobj);
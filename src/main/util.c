@@ -28,6 +28,7 @@
 #include <R_ext/Print.h>
 #include <ctype.h>		/* for isspace */
 #include <float.h>		/* for DBL_MAX */
+#include <stdint.h>		/* for uint64_t */
 #include <R_ext/Itermacros.h> /* for ITERATE_BY_REGION */
 
 #undef COMPILING_R
@@ -1877,6 +1878,109 @@ int attribute_hidden Rf_AdobeSymbol2ucs2(int n)
     else return 0;
 }
 
+/* Correctly rounded conversion of the decimal m * 10^e (with m > 0)
+   by the algorithm of Eisel and Lemire, see D. Lemire (2021) Number
+   parsing at a gigabyte per second, Software: Practice and Experience
+   51, 1700-1727.  Returns FALSE when the result cannot be decided this
+   way (including subnormals and overflow): that is rare. */
+
+#include "pow10_table.h"
+
+static R_INLINE uint64_t mul128(uint64_t a, uint64_t b, uint64_t *lo)
+{
+#ifdef __SIZEOF_INT128__
+    unsigned __int128 r = (unsigned __int128) a * b;
+    *lo = (uint64_t) r;
+    return (uint64_t) (r >> 64);
+#else
+    uint64_t a0 = (uint32_t) a, a1 = a >> 32, b0 = (uint32_t) b, b1 = b >> 32,
+	p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1,
+	mid = (p00 >> 32) + (uint32_t) p01 + (uint32_t) p10;
+    *lo = (mid << 32) | (uint32_t) p00;
+    return p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+#endif
+}
+
+static Rboolean eisel_lemire(uint64_t m, int e, double *x)
+{
+    uint64_t hi, lo, yhi, ylo, bits;
+    int clz = 0;
+
+    if (e < R_POW10_MIN || e > R_POW10_MAX) return FALSE;
+    const uint64_t *pow = R_pow10_128[e - R_POW10_MIN];
+#if defined(__GNUC__)
+    clz = __builtin_clzll(m);
+    m <<= clz;
+#else
+    while (!(m >> 63)) {
+	m <<= 1;
+	clz++;
+    }
+#endif
+    /* 217706/2^16 is log2(10) */
+    uint64_t exp2 = (uint64_t) (((217706 * e) >> 16) + 64 + 1023 - clz);
+
+    hi = mul128(m, pow[0], &lo);
+    if ((hi & 0x1FF) == 0x1FF && lo + m < m) {
+	/* the product might be out in the last bits: use all 128 */
+	yhi = mul128(m, pow[1], &ylo);
+	if (lo + yhi < lo) hi++;
+	lo += yhi;
+	if ((hi & 0x1FF) == 0x1FF && lo + 1 == 0 && ylo + m < m)
+	    return FALSE;
+    }
+    int msb = (int) (hi >> 63);
+    bits = hi >> (msb + 9);
+    exp2 -= 1 ^ msb;
+    /* exactly half-way between two doubles? */
+    if (lo == 0 && (hi & 0x1FF) == 0 && (bits & 3) == 1) return FALSE;
+    bits += bits & 1;
+    bits >>= 1;
+    if (bits >> 53) {
+	bits >>= 1;
+	exp2++;
+    }
+    if (exp2 - 1 >= 0x7FF - 1) return FALSE;
+    bits = (exp2 << 52) | (bits & 0x000FFFFFFFFFFFFFU);
+    memcpy(x, &bits, sizeof(double));
+    return TRUE;
+}
+
+/* The decimal number with digits at p (and decimal mark dec) times 10^e,
+   by the C library, which is correctly rounded but slower.  Digits past
+   the 780th can only matter through being non-zero. */
+static double strtod_decimal(const char *p, char dec, int e)
+{
+    char buf[800];
+    int nd = 0;
+    Rboolean sticky = FALSE;
+
+    for (; *p >= '0' && *p <= '9'; p++) {
+	if (nd < 780) {
+	    if (nd || *p != '0') buf[nd++] = *p;
+	} else {
+	    e++;
+	    if (*p != '0') sticky = TRUE;
+	}
+    }
+    if (*p == dec) {
+	for (p++; *p >= '0' && *p <= '9'; p++) {
+	    if (nd < 780) {
+		if (nd || *p != '0') buf[nd++] = *p;
+		e--;
+	    } else if (*p != '0') sticky = TRUE;
+	}
+    }
+    if (!nd) return 0.0;
+    if (sticky) {
+	buf[nd++] = '1';
+	e--;
+    }
+    /* no decimal point, so this does not depend on the locale */
+    snprintf(buf + nd, sizeof(buf) - nd, "e%d", e);
+    return strtod(buf, NULL);
+}
+
 double R_strtod5(const char *str, char **endptr, char dec,
 		 Rboolean NA, int exact)
 {
@@ -1900,23 +2004,26 @@ double R_strtod5(const char *str, char **endptr, char dec,
     default: ;
     }
 
-    if (strncasecmp(p, "NaN", 3) == 0) {
+    /* (the comparisons are not cheap, so only made when they might match) */
+    if ((*p == 'N' || *p == 'n') && strncasecmp(p, "NaN", 3) == 0) {
 	ans = R_NaN;
 	p += 3;
 	goto done;
-    /* C99 specifies this: must come first to avoid 'inf' match */
-    } else if (strncasecmp(p, "infinity", 8) == 0) {
-	ans = R_PosInf;
-	p += 8;
-	goto done;
-    } else if (strncasecmp(p, "Inf", 3) == 0) {
-	ans = R_PosInf;
-	p += 3;
-	goto done;
+    } else if (*p == 'I' || *p == 'i') {
+	/* C99 specifies this: must come first to avoid 'inf' match */
+	if (strncasecmp(p, "infinity", 8) == 0) {
+	    ans = R_PosInf;
+	    p += 8;
+	    goto done;
+	} else if (strncasecmp(p, "Inf", 3) == 0) {
+	    ans = R_PosInf;
+	    p += 3;
+	    goto done;
+	}
     }
 
     int n, expn = 0;
-    if(strlen(p) > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) { // Hexadecimal "0x....."
+    if(p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && p[2]) { // Hexadecimal "0x....."
 	int exph = -1;
 
 	/* This will overflow to Inf if appropriate */
@@ -1928,8 +2035,8 @@ double R_strtod5(const char *str, char **endptr, char dec,
 	    else break;
 	    if (exph >= 0) exph += 4;
 	}
-#define strtod_EXACT_CLAUSE						\
-	if(exact && ans > 0x1.fffffffffffffp52) {			\
+#define strtod_EXACT_CLAUSE(big)					\
+	if(exact && (big)) {						\
 	    if(exact == NA_LOGICAL)					\
 		warning(_(						\
 		"accuracy loss in conversion from \"%s\" to numeric"),	\
@@ -1940,7 +2047,7 @@ double R_strtod5(const char *str, char **endptr, char dec,
 		goto done;						\
 	    }								\
 	}
-	strtod_EXACT_CLAUSE;
+	strtod_EXACT_CLAUSE(ans > 0x1.fffffffffffffp52);
 	if (*p == 'p' || *p == 'P') {
 	    int expsign = 1;
 	    double p2 = 2.0;
@@ -1980,17 +2087,42 @@ double R_strtod5(const char *str, char **endptr, char dec,
 	goto done;
     } // end {hexadecimal case}
 
-    int ndigits = 0;
-    for ( ; *p >= '0' && *p <= '9'; p++, ndigits++) ans = 10*ans + (*p - '0');
-    if (*p == dec)
-	for (p++; *p >= '0' && *p <= '9'; p++, ndigits++, expn--)
-	    ans = 10*ans + (*p - '0');
+    /* The first 19 significant digits are exact in m: any others are
+       only noted. */
+    const char *digits = p;
+    uint64_t m = 0;
+    int ndigits = 0, nsig = 0, expe = 0;
+    Rboolean dropped = FALSE, truncated = FALSE;
+    for ( ; *p == '0'; p++) ndigits++;
+    for ( ; *p >= '0' && *p <= '9'; p++, ndigits++)
+	if (nsig < 19) {
+	    m = 10*m + (*p - '0');
+	    nsig++;
+	} else {
+	    expn++;
+	    dropped = TRUE;
+	    if (*p != '0') truncated = TRUE;
+	}
+    if (*p == dec) {
+	p++;
+	if (!nsig)
+	    for ( ; *p == '0'; p++, ndigits++) expn--;
+	for ( ; *p >= '0' && *p <= '9'; p++, ndigits++)
+	    if (nsig < 19) {
+		m = 10*m + (*p - '0');
+		nsig++;
+		expn--;
+	    } else {
+		dropped = TRUE;
+		if (*p != '0') truncated = TRUE;
+	    }
+    }
     if (ndigits == 0) {
 	ans = NA_REAL;
 	p = str; /* back out */
 	goto done;
     }
-    strtod_EXACT_CLAUSE;
+    strtod_EXACT_CLAUSE(dropped || m > 0x1fffffffffffffU);
 
     if (*p == 'e' || *p == 'E') {
 	int expsign = 1;
@@ -2000,34 +2132,18 @@ double R_strtod5(const char *str, char **endptr, char dec,
 	default: ;
 	}
 	for (n = 0; *p >= '0' && *p <= '9'; p++) n = (n < MAX_EXPONENT_PREFIX) ? n * 10 + (*p - '0') : n;
-	expn += expsign * n;
-    }
-
-    /* avoid unnecessary underflow for large negative exponents */
-    if (expn + ndigits < -300) {
-	for (n = 0; n < ndigits; n++) ans /= 10.0;
-	expn += ndigits;
-    }
-    LDOUBLE p10 = 10., fac = 1.0;
-    if (expn < -307) { /* use underflow, not overflow */
-	for (n = -expn, fac = 1.0; n; n >>= 1, p10 *= p10)
-	    if (n & 1) fac /= p10;
-	ans *= fac;
-    } else if (expn < 0) { /* positive powers are exact */
-	for (n = -expn, fac = 1.0; n; n >>= 1, p10 *= p10)
-	    if (n & 1) fac *= p10;
-	ans /= fac;
-    } else if (ans != 0.0) { /* PR#15976:  allow big exponents on 0, e.g. 0E4933 */
-	for (n = expn, fac = 1.0; n; n >>= 1, p10 *= p10)
-	    if (n & 1) fac *= p10;
-	ans *= fac;
+	expe = expsign * n;
     }
 
-    /* explicit overflow to infinity */
-    if (ans > DBL_MAX) {
-	if (endptr) *endptr = (char *) p;
-	return (sign > 0) ? R_PosInf : R_NegInf;
-    }
+    /* If the digits were truncated, the result is m * 10^expn rounded
+       only if it is the same for m + 1. */
+    double x, y;
+    if (m == 0 && !truncated)
+	x = 0.0; /* PR#15976:  allow big exponents on 0, e.g. 0E4933 */
+    else if (!eisel_lemire(m, expn + expe, &x) ||
+	     (truncated && (!eisel_lemire(m + 1, expn + expe, &y) || x != y)))
+	x = strtod_decimal(digits, dec, expe);
+    ans = x;
 
 done:
     if (endptr) *endptr = (char *) p;
@@ -2050,6 +2166,148 @@ double R_atof(const char *str)
     return R_strtod5(str, NULL, '.', FALSE, FALSE);
 }
 
+/* Bits b to b + 63 of the 192-bit p[2]:p[1]:p[0], for -64 < b */
+static R_INLINE uint64_t bits192(const uint64_t *p, int b)
+{
+    if (b >= 192) return 0;
+    if (b < 0) return p[0] << -b;
+    int i = b >> 6, r = b & 63;
+    uint64_t v = p[i] >> r;
+    if (r && i < 2) v |= p[i + 1] << (64 - r);
+    return v;
+}
+
+/* x * 10^k rounded to the nearest integer, for finite x >= 0, using the
+   table of R_strtod5().  Returns FALSE when that needs more than 64 bits
+   or is too close to a tie for the 128-bit powers to decide (including
+   exact ties): the caller then leaves it to the C library. */
+static Rboolean scaled_round(double x, int k, uint64_t *N)
+{
+    uint64_t bits, m, p[3], lo, hi;
+    int q;
+
+    if (k < R_POW10_MIN || k > R_POW10_MAX) return FALSE;
+    memcpy(&bits, &x, sizeof(double));
+    m = bits & 0x000FFFFFFFFFFFFFU;
+    q = (int) (bits >> 52) & 0x7FF;
+    if (q) {
+	m |= (uint64_t) 1 << 52;
+	q -= 1075;
+    } else q = -1074;
+    if (m == 0) {
+	*N = 0;
+	return TRUE;
+    }
+    const uint64_t *pow = R_pow10_128[k - R_POW10_MIN];
+    hi = mul128(m, pow[1], &p[0]);
+    p[2] = mul128(m, pow[0], &lo);
+    p[1] = lo + hi;
+    if (p[1] < lo) p[2]++;
+    /* x * 10^k is about p * 2^-s, low by less than one part in 2^127 */
+    int s = 127 - q - ((217706 * k) >> 16);
+    if (s < 64) return FALSE;
+    if (s < 128 && bits192(p, s + 64)) return FALSE;
+    uint64_t n = s < 192 ? bits192(p, s) : 0,
+	f = s < 256 ? bits192(p, s - 64) : 0,
+	half = (uint64_t) 1 << 63;
+    /* the fraction is in [f, f + 3) / 2^64 */
+    if (f > half) {
+	if (++n == 0) return FALSE;
+    } else if (f > half - 4) return FALSE;
+    *N = n;
+    return TRUE;
+}
+
+static const uint64_t pow10_64[] = {
+    1U, 10U, 100U, 1000U, 10000U, 100000U, 1000000U, 10000000U, 100000000U,
+    1000000000U, 10000000000U, 100000000000U, 1000000000000U,
+    10000000000000U, 100000000000000U, 1000000000000000U,
+    10000000000000000U, 100000000000000000U, 1000000000000000000U,
+    10000000000000000000U
+};
+
+/* Format finite x exactly as
+       snprintf(buf, size, e ? "%*.*e" : "%*.*f", w, d, x)
+   (with the '#' flag if alt) does, but in most cases without the C
+   library, which is slow for this.  The digits are those of x scaled by
+   a power of ten and correctly rounded, so the result is the same.
+   Uses no static storage, so can be used in threads. */
+void R_sprintReal(char *buf, size_t size, double x, int w, int d,
+		  Rboolean e, Rboolean alt)
+{
+    char dig[24], *out = buf;
+    uint64_t N = 0, bits;
+    int e10 = 0, nd, len;
+
+    memcpy(&bits, &x, sizeof(double));
+    Rboolean neg = (Rboolean) (bits >> 63);
+    if (neg) x = -x;
+    if (d < 0 || d > 18 || w < 0) goto fallback;
+    if (e) {
+	if (x != 0) {
+	    /* 10^e10 <= 2^e2 <= x, so the exponent is e10 or e10 + 1 */
+	    int e2 = (int) ((bits >> 52) & 0x7FF);
+	    if (e2) e2 -= 1023;
+	    else {
+		uint64_t m = bits & 0x000FFFFFFFFFFFFFU;
+		for (e2 = -1022; !(m >> 52); m <<= 1) e2--;
+	    }
+	    e10 = (e2 * 78913) >> 18;
+	    if (!scaled_round(x, d - e10, &N)) goto fallback;
+	    if (N > pow10_64[d + 1]) {
+		e10++;
+		if (!scaled_round(x, d - e10, &N)) goto fallback;
+	    }
+	    if (N == pow10_64[d + 1]) {
+		N = pow10_64[d];
+		e10++;
+	    }
+	}
+	nd = d + 1;
+    } else {
+	if (!scaled_round(x, d, &N)) goto fallback;
+	for (nd = 1; nd < 20 && N >= pow10_64[nd]; nd++);
+	if (nd <= d) nd = d + 1;
+    }
+    for (int i = nd - 1; i >= 0; i--) {
+	dig[i] = (char) ('0' + N % 10);
+	N /= 10;
+    }
+
+    int ndot = (d || alt), ne = 0;
+    if (e) ne = (e10 <= -100 || e10 >= 100) ? 5 : 4;
+    len = neg + nd + ndot + ne;
+    if ((size_t) (len > w ? len : w) >= size) goto fallback;
+    for (; w > len; w--) *out++ = ' ';
+    if (neg) *out++ = '-';
+    int nint = e ? 1 : nd - d;
+    memcpy(out, dig, nint);
+    out += nint;
+    if (ndot) *out++ = '.';
+    memcpy(out, dig + nint, nd - nint);
+    out += nd - nint;
+    if (e) {
+	*out++ = 'e';
+	*out++ = e10 < 0 ? '-' : '+';
+	if (e10 < 0) e10 = -e10;
+	if (e10 >= 100) {
+	    *out++ = (char) ('0' + e10 / 100);
+	    e10 %= 100;
+	}
+	*out++ = (char) ('0' + e10 / 10);
+	*out++ = (char) ('0' + e10 % 10);
+    }
+    *out = '\0';
+    return;
+
+fallback:
+    if (neg) x = -x;
+    if (e)
+	snprintf(buf, size, alt ? "%#*.*e" : "%*.*e", w, d, x);
+    else
+	snprintf(buf, size, alt ? "%#*.*f" : "%*.*f", w, d, x);
+}
+
 /* enc2native and enc2utf8, but they are the same in a UTF-8 locale */
 /* primitive */
 SEXP attribute_hidden do_enc2(SEXP call, SEXP op, SEXP args, SEXP env)